@@ -0,0 +1,348 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Both solvers are linked in-process, so a run measures the search itself
+// and not process start-up or the tables a fresh process has to set up
+#include "board.h"
+#include "prog.h"
+#include "solver.h"
+
+#ifndef HAS_BUILTIN_BOARD
+#error "bench only knows the built-in board (BOARD_CELLS=14)"
+#endif
+
+// Runs the versioned puzzle corpus through the chosen engines and prints one
+// JSON object: per engine and group (piece count and solution length), the
+// median, p95 and p99 latency of a solve and the states expanded per second.
+// Every answer is checked against the length recorded in the corpus. For
+// example
+//
+//   make bench
+//   ./bench --engines legacy,bfs,astar --runs 10 > results.json
+//
+// "legacy" is the linked-node solver in prog.c; the other names are the
+// engines of libsolver (see solver.h), as chosen by the options of prog.
+#define BENCH_MAX_PUZZLES 1024
+#define BENCH_MAX_GROUPS 64
+#define BENCH_MAX_MOVES 1024
+
+typedef struct BenchPuzzle
+{
+    char pieces[4][NUM_POSITIONS + 1]; // "" for a colour with no pieces
+    int depth;                         // Recorded solution length, -1 for none
+    int group;
+} BenchPuzzle;
+
+typedef struct BenchGroup
+{
+    int pieces;
+    const char *depths; // One of depth_buckets
+    double *latencies;  // Microseconds, one per measured solve
+    int count;
+    int puzzles;
+    double seconds;
+    unsigned long expanded;
+    int mismatches;
+} BenchGroup;
+
+typedef struct BenchEngine
+{
+    const char *name;
+    int legacy;
+    Engine engine;
+} BenchEngine;
+
+static const BenchEngine bench_engines[] = {
+    {"legacy", 1, ENGINE_BFS},
+    {"bfs", 0, ENGINE_BFS},
+    {"parallel", 0, ENGINE_PARALLEL_BFS},
+    {"bidirectional", 0, ENGINE_BIDIRECTIONAL},
+    {"layered", 0, ENGINE_LAYERED},
+    {"mod3", 0, ENGINE_MOD3},
+    {"astar", 0, ENGINE_ASTAR},
+    {"idastar", 0, ENGINE_IDASTAR},
+    {"external", 0, ENGINE_EXTERNAL},
+};
+
+static const char *depth_bucket(int depth)
+{
+    if (depth < 0)
+        return "none";
+    if (depth < 10)
+        return "1-9";
+    if (depth < 20)
+        return "10-19";
+    if (depth < 40)
+        return "20-39";
+    return "40+";
+}
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int compare_latencies(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, int count, double p)
+{
+    int index = (int)(p * (count - 1) + 0.5);
+    return sorted[index];
+}
+
+// Reads the corpus and its "# Benchmark corpus vN" first line. Returns the
+// number of puzzles, or -1 on error.
+static int load_corpus(const char *path, BenchPuzzle puzzles[], int *version)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+    char line[256];
+    int count = 0;
+    *version = -1;
+    if (fgets(line, sizeof(line), file) == NULL || sscanf(line, "# Benchmark corpus v%d", version) != 1)
+    {
+        fprintf(stderr, "Error: %s does not start with a corpus version line.\n", path);
+        fclose(file);
+        return -1;
+    }
+    for (int number = 2; fgets(line, sizeof(line), file) != NULL; number++)
+    {
+        char fields[4][NUM_POSITIONS + 2];
+        char error[128];
+        int depth;
+        int fields_read = sscanf(line, "%15s %15s %15s %15s %d", fields[0], fields[1], fields[2], fields[3], &depth);
+        if (fields_read <= 0 || fields[0][0] == '#')
+            continue;
+        const char *pieces[4];
+        for (int i = 0; i < 4; i++)
+            pieces[i] = strcmp(fields[i], "-") == 0 ? "" : fields[i];
+        if (fields_read != 5 || !validate_puzzle(pieces, error, sizeof(error)))
+        {
+            fprintf(stderr, "Error: %s:%d: %s\n", path, number,
+                    fields_read != 5 ? "Expected a puzzle and its solution length" : error);
+            fclose(file);
+            return -1;
+        }
+        if (count == BENCH_MAX_PUZZLES)
+        {
+            fprintf(stderr, "Error: %s has more than %d puzzles.\n", path, BENCH_MAX_PUZZLES);
+            fclose(file);
+            return -1;
+        }
+        for (int i = 0; i < 4; i++)
+            strcpy(puzzles[count].pieces[i], pieces[i]);
+        puzzles[count].depth = depth;
+        count++;
+    }
+    fclose(file);
+    return count;
+}
+
+// Solves one puzzle with one engine. Returns the solution length, -1 when
+// there is none and -2 on failure, and adds the states expanded.
+static int bench_solve(const BenchEngine *engine, Solver *solver, const BenchPuzzle *puzzle,
+                       char (*legacy_moves)[3], unsigned long *expanded)
+{
+    if (engine->legacy)
+    {
+        int path_length = 0;
+        SolverStats legacy_stats;
+        int found = solvePuzzle(puzzle->pieces[0], puzzle->pieces[1], puzzle->pieces[2], puzzle->pieces[3],
+                                legacy_moves, BENCH_MAX_MOVES, &path_length, &legacy_stats);
+        *expanded += legacy_stats.statesExpanded;
+        if (found < 0)
+            return -2;
+        return found ? path_length - 1 : -1; // The path starts with the "--" entry
+    }
+    uint32_t board_start = init_board(puzzle->pieces[0], puzzle->pieces[1]);
+    uint32_t board_goal = init_board(puzzle->pieces[2], puzzle->pieces[3]);
+    const int *moves;
+    int move_count;
+    int found = solve(solver, board_start, board_goal, &moves, &move_count);
+    *expanded += solver_stats(solver)->expanded;
+    if (found < 0)
+        return -2;
+    return found ? move_count : -1;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *corpus_path = "bench_corpus_v1.txt";
+    const char *engine_names = "legacy,bfs";
+    int runs = 5, warmup = 1, threads = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--corpus") == 0 && i + 1 < argc)
+            corpus_path = argv[++i];
+        else if (strcmp(argv[i], "--engines") == 0 && i + 1 < argc)
+            engine_names = argv[++i];
+        else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+            runs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+            warmup = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else
+        {
+            fprintf(stderr, "Usage: %s [--corpus FILE] [--engines a,b,...] [--runs N] [--warmup N] [--threads N]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (runs <= 0 || warmup < 0)
+    {
+        fprintf(stderr, "Error: Need at least one run and no negative warm-up.\n");
+        return 1;
+    }
+    if (threads <= 0)
+        threads = sysconf(_SC_NPROCESSORS_ONLN) > 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+
+    static BenchPuzzle puzzles[BENCH_MAX_PUZZLES];
+    int corpus_version;
+    int puzzle_count = load_corpus(corpus_path, puzzles, &corpus_version);
+    if (puzzle_count <= 0)
+    {
+        if (puzzle_count == 0)
+            fprintf(stderr, "Error: %s has no puzzles.\n", corpus_path);
+        return 1;
+    }
+
+    // Groups appear in corpus order
+    static BenchGroup groups[BENCH_MAX_GROUPS];
+    int group_count = 0;
+    for (int p = 0; p < puzzle_count; p++)
+    {
+        int pieces = strlen(puzzles[p].pieces[0]) + strlen(puzzles[p].pieces[1]);
+        const char *depths = depth_bucket(puzzles[p].depth);
+        int g = 0;
+        while (g < group_count && (groups[g].pieces != pieces || strcmp(groups[g].depths, depths) != 0))
+            g++;
+        if (g == group_count)
+        {
+            if (group_count == BENCH_MAX_GROUPS)
+            {
+                fprintf(stderr, "Error: The corpus has more than %d groups.\n", BENCH_MAX_GROUPS);
+                return 1;
+            }
+            groups[g].pieces = pieces;
+            groups[g].depths = depths;
+            group_count++;
+        }
+        groups[g].puzzles++;
+        puzzles[p].group = g;
+    }
+    for (int g = 0; g < group_count; g++)
+    {
+        groups[g].latencies = (double *)malloc((size_t)groups[g].puzzles * runs * sizeof(double));
+        if (groups[g].latencies == NULL)
+        {
+            perror("Failed to allocate memory for latencies");
+            return 1;
+        }
+    }
+    char(*legacy_moves)[3] = malloc(BENCH_MAX_MOVES * sizeof(*legacy_moves));
+    if (legacy_moves == NULL)
+    {
+        perror("Failed to allocate memory for path");
+        return 1;
+    }
+
+    int total_mismatches = 0;
+    printf("{\n  \"corpus\": \"%s\",\n  \"corpus_version\": %d,\n  \"puzzles\": %d,\n"
+           "  \"runs\": %d,\n  \"warmup\": %d,\n  \"results\": [",
+           corpus_path, corpus_version, puzzle_count, runs, warmup);
+    int first_result = 1;
+    const char *name = engine_names;
+    while (*name != '\0')
+    {
+        size_t length = strcspn(name, ",");
+        const BenchEngine *engine = NULL;
+        for (size_t e = 0; e < sizeof(bench_engines) / sizeof(bench_engines[0]); e++)
+        {
+            if (strlen(bench_engines[e].name) == length && strncmp(bench_engines[e].name, name, length) == 0)
+                engine = &bench_engines[e];
+        }
+        if (engine == NULL)
+        {
+            fprintf(stderr, "Error: Unknown engine %.*s\n", (int)length, name);
+            return 1;
+        }
+        name += length + (name[length] == ',');
+
+        // One solver for the whole corpus, as in --batch
+        Solver *solver = NULL;
+        if (!engine->legacy && (solver = solver_create(engine->engine, threads)) == NULL)
+            return 1;
+        for (int g = 0; g < group_count; g++)
+        {
+            groups[g].count = 0;
+            groups[g].seconds = 0;
+            groups[g].expanded = 0;
+            groups[g].mismatches = 0;
+        }
+        for (int p = 0; p < puzzle_count; p++)
+        {
+            BenchGroup *group = &groups[puzzles[p].group];
+            unsigned long expanded = 0;
+            for (int w = 0; w < warmup; w++)
+                bench_solve(engine, solver, &puzzles[p], legacy_moves, &expanded);
+            for (int r = 0; r < runs; r++)
+            {
+                expanded = 0;
+                double start = now_ns();
+                int depth = bench_solve(engine, solver, &puzzles[p], legacy_moves, &expanded);
+                double elapsed = now_ns() - start;
+                if (depth == -2)
+                    return 1;
+                group->latencies[group->count++] = elapsed / 1e3;
+                group->seconds += elapsed / 1e9;
+                group->expanded += expanded;
+                if (depth != puzzles[p].depth && r == 0)
+                {
+                    fprintf(stderr, "Error: %s solved %s %s %s %s in %d moves, expected %d\n", engine->name,
+                            puzzles[p].pieces[0], puzzles[p].pieces[1], puzzles[p].pieces[2], puzzles[p].pieces[3],
+                            depth, puzzles[p].depth);
+                    group->mismatches++;
+                }
+            }
+        }
+        solver_destroy(solver);
+
+        for (int g = 0; g < group_count; g++)
+        {
+            BenchGroup *group = &groups[g];
+            qsort(group->latencies, group->count, sizeof(double), compare_latencies);
+            printf("%s\n    {\"engine\": \"%s\", \"pieces\": %d, \"depth\": \"%s\", \"puzzles\": %d, \"samples\": %d, "
+                   "\"median_us\": %.1f, \"p95_us\": %.1f, \"p99_us\": %.1f, \"states_per_second\": %.0f, "
+                   "\"mismatches\": %d}",
+                   first_result ? "" : ",", engine->name, group->pieces, group->depths, group->puzzles, group->count,
+                   percentile(group->latencies, group->count, 0.50), percentile(group->latencies, group->count, 0.95),
+                   percentile(group->latencies, group->count, 0.99),
+                   group->seconds > 0 ? group->expanded / group->seconds : 0.0, group->mismatches);
+            first_result = 0;
+            total_mismatches += group->mismatches;
+        }
+    }
+    printf("\n  ]\n}\n");
+
+    for (int g = 0; g < group_count; g++)
+        free(groups[g].latencies);
+    free(legacy_moves);
+    return total_mismatches == 0 ? 0 : 2;
+}
@@ -0,0 +1,93 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "board.h"
+
+#ifndef HAS_BUILTIN_BOARD
+#error "bench_movegen only knows the built-in board (BOARD_CELLS=14)"
+#endif
+
+// Compares the per-cell move generator with the bitboard one (see board.h).
+// Both are first checked to produce the same children in the same order for
+// every board of each piece count, then timed over all of those boards.
+//
+//   cc -O2 -o bench_movegen bench_movegen.c -std=c99
+//   ./bench_movegen [passes]
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[])
+{
+    int passes = argc > 1 ? atoi(argv[1]) : 20;
+    if (passes <= 0)
+        passes = 1;
+
+    static const int configs[][2] = {{1, 1}, {2, 2}, {3, 3}, {4, 4}, {5, 5}, {6, 6}, {4, 2}, {7, 5}};
+    int config_count = sizeof(configs) / sizeof(configs[0]);
+    init_binomials();
+
+    uint32_t children[MAX_CHILDREN], expected[MAX_CHILDREN];
+    int moves[MAX_CHILDREN], expected_moves[MAX_CHILDREN];
+    printf("%-8s %10s %14s %14s %8s\n", "pieces", "boards", "generic ns", "bitboard ns", "speedup");
+    for (int c = 0; c < config_count; c++)
+    {
+        int whites = configs[c][0], blacks = configs[c][1];
+        uint32_t size = count_states(whites, blacks);
+        uint32_t *boards = (uint32_t *)malloc(size * sizeof(uint32_t));
+        if (boards == NULL)
+        {
+            perror("Failed to allocate memory for boards");
+            return 1;
+        }
+        for (uint32_t rank = 0; rank < size; rank++)
+        {
+            boards[rank] = unrank_board(rank, whites, blacks);
+            int count = generate_children_bitboard(boards[rank], children, moves);
+            int expected_count = generate_children_generic(boards[rank], board_neighbors, expected, expected_moves);
+            int same = count == expected_count;
+            for (int i = 0; same && i < count; i++)
+                same = children[i] == expected[i] && moves[i] == expected_moves[i];
+            if (!same)
+            {
+                fprintf(stderr, "Error: Generators disagree on board %x\n", boards[rank]);
+                return 1;
+            }
+        }
+
+        // The checksum keeps the compiler from dropping the generated children
+        uint64_t checksum = 0;
+        double start = now_ns();
+        for (int p = 0; p < passes; p++)
+            for (uint32_t i = 0; i < size; i++)
+            {
+                int count = generate_children_generic(boards[i], board_neighbors, children, moves);
+                checksum += count ? children[count - 1] : 0;
+            }
+        double generic = (now_ns() - start) / ((double)passes * size);
+
+        start = now_ns();
+        for (int p = 0; p < passes; p++)
+            for (uint32_t i = 0; i < size; i++)
+            {
+                int count = generate_children_bitboard(boards[i], children, moves);
+                checksum -= count ? children[count - 1] : 0;
+            }
+        double bitboard = (now_ns() - start) / ((double)passes * size);
+
+        char label[16];
+        snprintf(label, sizeof(label), "%dw %db", whites, blacks);
+        printf("%-8s %10u %14.2f %14.2f %7.1fx%s\n", label, size, generic, bitboard, generic / bitboard,
+               checksum == 0 ? "" : " (checksum mismatch)");
+        free(boards);
+    }
+    return 0;
+}
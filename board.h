@@ -0,0 +1,580 @@
+#ifndef BOARD_H
+#define BOARD_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "board_type.h"
+
+// Packed board shared by solver.c, prog_bin.c and the table generators. Each
+// position takes two bits, A in the highest pair and the last cell in the
+// lowest: 00 is empty, 01 a white piece and 11 a black piece.
+
+#define NUM_POSITIONS BOARD_CELLS
+
+#define SET_BIT(variable, bit) ((variable) |= (1UL << (bit)))
+#define CLEAR_BIT(variable, bit) ((variable) &= ~(1UL << (bit)))
+#define CHECK_BIT(variable, bit) (((variable) >> (bit)) & 1)
+
+// Pairs in use, and the low bit of each: a cell is occupied exactly when its
+// low bit is set
+#define BOARD_MASK (~(board_t)0 >> (BOARD_BITS - 2 * NUM_POSITIONS))
+#define CELL_LOW_BITS (BOARD_MASK / 3)
+
+#if BOARD_CELLS == 14
+// Other cell counts have no built-in board and load theirs with
+// load_topology
+#define HAS_BUILTIN_BOARD
+
+static const int board_neighbors[NUM_POSITIONS][4] = {
+    /* A */ {1, -1, -1, -1},
+    /* B */ {0, 2, -1, -1},
+    /* C */ {1, 3, 11, -1},
+    /* D */ {2, 4, -1, -1},
+    /* E */ {3, 5, -1, -1},
+    /* F */ {4, 6, -1, -1},
+    /* G */ {5, -1, -1, -1},
+    /* H */ {8, -1, -1, -1},
+    /* I */ {7, 9, -1, -1},
+    /* J */ {8, 10, -1, -1},
+    /* K */ {9, 11, -1, -1},
+    /* L */ {2, 10, 12, -1},
+    /* M */ {11, 13, -1, -1},
+    /* N */ {12, -1, -1, -1}};
+#endif
+
+static inline int cell_offset(int cell)
+{
+    return 2 * (NUM_POSITIONS - 1 - cell);
+}
+
+static inline char cell_name(int cell)
+{
+    return CELL_NAMES[cell];
+}
+
+// Returns -1 for a character that names no cell of this build
+static inline int cell_index(char name)
+{
+    const char *found = name != '\0' ? strchr(CELL_NAMES, name) : NULL;
+    return found != NULL && found - CELL_NAMES < NUM_POSITIONS ? (int)(found - CELL_NAMES) : -1;
+}
+
+static inline int pos_offset(char pos)
+{
+    return cell_offset(cell_index(pos));
+}
+
+static inline board_t init_board(const char *white_pieces, const char *black_pieces)
+{
+    board_t board = 0;
+    for (int i = 0; white_pieces[i] != '\0'; i++)
+    {
+        int offset = pos_offset(white_pieces[i]);
+        board |= ((board_t)0b01 << offset); // Set the bit for white pieces
+    }
+    for (int i = 0; black_pieces[i] != '\0'; i++)
+    {
+        int offset = pos_offset(black_pieces[i]);
+        board |= ((board_t)0b11 << offset); // Set the bit for black pieces
+    }
+    return board;
+}
+
+static inline void move_piece(board_t *board, char from, char to)
+{
+    int from_offset = pos_offset(from);
+    int to_offset = pos_offset(to);
+
+    board_t mask = 0b11;
+    board_t piece = (*board >> from_offset) & mask;
+
+    if (piece == 0)
+    {
+        fprintf(stderr, "Error: No piece at position %c\n", from);
+        return;
+    }
+    if ((*board >> to_offset) & 1)
+    {
+        fprintf(stderr, "Error: Position %c is already occupied\n", to);
+        return;
+    }
+
+    *board = (*board & ~(mask << from_offset) & ~(mask << to_offset)) | (piece << to_offset); // Set the piece in the new position
+}
+
+// Each move uses a different edge, and with at most four neighbours per
+// cell there are at most 2 * NUM_POSITIONS edges
+#define MAX_CHILDREN (2 * NUM_POSITIONS > 32 ? 2 * NUM_POSITIONS : 32)
+
+// Writes every board reachable in one move into children[] (with the move
+// that produced it) and returns how many there are. Works for any graph;
+// children come out ordered by source cell, then in neighbour order.
+static inline int generate_children_generic(board_t board, const int neighbors[NUM_POSITIONS][4], board_t children[],
+                                            int moves[])
+{
+    int count = 0;
+    for (int i = 0; i < NUM_POSITIONS; i++)
+    {
+        int from_offset = cell_offset(i);
+        if (((board >> from_offset) & 0b01) == 0)
+            continue; // No piece at this position
+
+        board_t piece = (board >> from_offset) & 0b11;
+        board_t lifted = board & ~((board_t)0b11 << from_offset);
+        for (int j = 0; j < 4 && neighbors[i][j] != -1; j++)
+        {
+            int to_offset = cell_offset(neighbors[i][j]);
+            if (((board >> to_offset) & 0b11) == 0) // Empty position
+            {
+                children[count] = lifted | (piece << to_offset);
+                moves[count] = make_move(i, neighbors[i][j]);
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+#pragma region Topology Files
+// Boards other than the built-in one are read from a text file: "cells N"
+// followed by the edges, each written as the names of its two cells ("AB"
+// joins A and B). Anything after a # on a line is a comment. The built-in
+// board is
+//
+//   cells 14
+//   AB BC CD DE EF FG HI IJ JK KL LM MN CL
+//
+// N must be the cell count of the build. Neighbour lists are kept sorted, so
+// moves come out in the same order as on the built-in board.
+static inline int read_topology_token(FILE *file, char *token, size_t size)
+{
+    int c;
+    for (;;)
+    {
+        while ((c = fgetc(file)) == ' ' || c == '\t' || c == '\n' || c == '\r')
+            ;
+        if (c != '#')
+            break;
+        while ((c = fgetc(file)) != EOF && c != '\n')
+            ;
+    }
+    size_t length = 0;
+    while (c != EOF && c != ' ' && c != '\t' && c != '\n' && c != '\r' && c != '#')
+    {
+        if (length + 1 < size)
+            token[length++] = (char)c;
+        c = fgetc(file);
+    }
+    if (c == '#')
+        ungetc(c, file);
+    token[length] = '\0';
+    return length > 0;
+}
+
+// Fills neighbors from the file. Prints why and returns 0 when it cannot be
+// used.
+static inline int load_topology(const char *path, int neighbors[NUM_POSITIONS][4])
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        perror(path);
+        return 0;
+    }
+    char token[16];
+    int cells = 0;
+    if (!read_topology_token(file, token, sizeof(token)) || strcmp(token, "cells") != 0 ||
+        !read_topology_token(file, token, sizeof(token)) || (cells = atoi(token)) <= 0)
+    {
+        fprintf(stderr, "Error: %s does not start with \"cells N\".\n", path);
+        fclose(file);
+        return 0;
+    }
+    if (cells != NUM_POSITIONS)
+    {
+        fprintf(stderr, "Error: %s has %d cells, but this build has %d (rebuild with make BOARD_CELLS=%d).\n", path,
+                cells, NUM_POSITIONS, cells);
+        fclose(file);
+        return 0;
+    }
+
+    int degree[NUM_POSITIONS] = {0};
+    for (int i = 0; i < NUM_POSITIONS; i++)
+        for (int j = 0; j < 4; j++)
+            neighbors[i][j] = -1;
+    int ok = 1;
+    while (ok && read_topology_token(file, token, sizeof(token)))
+    {
+        int a = cell_index(token[0]), b = token[0] != '\0' ? cell_index(token[1]) : -1;
+        if (strlen(token) != 2 || a < 0 || b < 0 || a == b)
+        {
+            fprintf(stderr, "Error: %s has an invalid edge \"%s\".\n", path, token);
+            ok = 0;
+            break;
+        }
+        for (int j = 0; j < degree[a]; j++)
+        {
+            if (neighbors[a][j] == b)
+            {
+                fprintf(stderr, "Error: %s lists the edge %s twice.\n", path, token);
+                ok = 0;
+            }
+        }
+        if (ok && (degree[a] == 4 || degree[b] == 4))
+        {
+            fprintf(stderr, "Error: %s gives a cell of %s more than 4 neighbours.\n", path, token);
+            ok = 0;
+        }
+        if (ok)
+        {
+            neighbors[a][degree[a]++] = b;
+            neighbors[b][degree[b]++] = a;
+        }
+    }
+    fclose(file);
+    if (!ok)
+        return 0;
+
+    for (int i = 0; i < NUM_POSITIONS; i++)
+    {
+        for (int j = 1; j < degree[i]; j++)
+        {
+            for (int k = j; k > 0 && neighbors[i][k - 1] > neighbors[i][k]; k--)
+            {
+                int swap = neighbors[i][k];
+                neighbors[i][k] = neighbors[i][k - 1];
+                neighbors[i][k - 1] = swap;
+            }
+        }
+    }
+    return 1;
+}
+#pragma endregion
+
+#ifdef HAS_BUILTIN_BOARD
+#pragma region Bitboard Move Generation
+// On the built-in board every edge joins consecutive letters, except C-L.
+// One mask of low bits gives the occupied and empty cells, and a shift by
+// one pair lines every cell up with its neighbour in one direction. The edge
+// masks drop the pairs whose neighbour in that direction is not adjacent
+// (G-H is not an edge, and A and N have no outer neighbour).
+#define NEXT_EDGE_CELLS 0x05551554u // Cells joined to the next letter: all but G and N
+#define PREV_EDGE_CELLS 0x01554555u // Cells joined to the previous letter: all but A and H
+#define BRIDGE_CELLS 0x00400010u    // C and L
+#define C_OFFSET 22
+#define L_OFFSET 4
+#define BRIDGE_SHIFT (C_OFFSET - L_OFFSET)
+
+static inline void emit_child(uint32_t lifted, uint32_t piece, int from, int to_offset, uint32_t children[],
+                              int moves[], int *count)
+{
+    children[*count] = lifted | (piece << to_offset);
+    moves[*count] = make_move(from, NUM_POSITIONS - 1 - to_offset / 2);
+    (*count)++;
+}
+
+// Same children, in the same order, as generate_children_generic with
+// board_neighbors. Sources are walked from the highest pair down (A first)
+// with count-leading-zeros, so breadth-first searches keep finding the same
+// paths as before.
+static inline int generate_children_bitboard(uint32_t board, uint32_t children[], int moves[])
+{
+    uint32_t occupied = board & CELL_LOW_BITS;
+    uint32_t empty = ~board & CELL_LOW_BITS;
+    uint32_t to_next = occupied & (empty << 2) & NEXT_EDGE_CELLS;
+    uint32_t to_prev = occupied & (empty >> 2) & PREV_EDGE_CELLS;
+    uint32_t bridge = occupied & ((empty << BRIDGE_SHIFT) | (empty >> BRIDGE_SHIFT)) & BRIDGE_CELLS;
+
+    int count = 0;
+    uint32_t sources = to_next | to_prev | bridge;
+    while (sources != 0)
+    {
+        int offset = 31 - __builtin_clz(sources);
+        uint32_t bit = 1u << offset;
+        sources &= ~bit;
+
+        uint32_t piece = (board >> offset) & 0b11;
+        uint32_t lifted = board & ~(0b11u << offset);
+        int from = NUM_POSITIONS - 1 - offset / 2;
+        if ((bridge & bit) && offset == L_OFFSET) // L-C comes before L-K and L-M
+            emit_child(lifted, piece, from, C_OFFSET, children, moves, &count);
+        if (to_prev & bit)
+            emit_child(lifted, piece, from, offset + 2, children, moves, &count);
+        if (to_next & bit)
+            emit_child(lifted, piece, from, offset - 2, children, moves, &count);
+        if ((bridge & bit) && offset == C_OFFSET) // C-L comes after C-B and C-D
+            emit_child(lifted, piece, from, L_OFFSET, children, moves, &count);
+    }
+    return count;
+}
+#pragma endregion
+
+#pragma region Board Symmetry
+// Mapping cell i to cell 13 - i (A-N, B-M, C-L, ...) takes the board graph
+// onto itself. In the packed board that reverses the order of the pairs,
+// which is a fixed bit permutation done with a few mask-and-shift swaps.
+// Moves ignore colour, so mirroring and then swapping colours is also a
+// symmetry when both colours have the same number of pieces.
+#define SYMMETRY_MIRROR 0b01
+#define SYMMETRY_MIRROR_SWAP 0b10
+
+static inline uint32_t mirror_board(uint32_t board)
+{
+    board = (board >> 16) | (board << 16);
+    board = ((board >> 8) & 0x00FF00FFu) | ((board & 0x00FF00FFu) << 8);
+    board = ((board >> 4) & 0x0F0F0F0Fu) | ((board & 0x0F0F0F0Fu) << 4);
+    board = ((board >> 2) & 0x33333333u) | ((board & 0x33333333u) << 2);
+    return board >> 4; // 16 pairs were reversed; the board uses the low 14
+}
+
+static inline uint32_t swap_colours(uint32_t board)
+{
+    return board ^ ((board & CELL_LOW_BITS) << 1);
+}
+
+// Symmetries that map the board onto itself
+static inline int board_symmetries(uint32_t board, int whites, int blacks)
+{
+    int symmetries = 0;
+    uint32_t mirrored = mirror_board(board);
+    if (mirrored == board)
+        symmetries |= SYMMETRY_MIRROR;
+    if (whites == blacks && swap_colours(mirrored) == board)
+        symmetries |= SYMMETRY_MIRROR_SWAP;
+    return symmetries;
+}
+
+// Smallest board among the images of the board under the given symmetries
+static inline uint32_t canonical_board(uint32_t board, int symmetries)
+{
+    if (symmetries == 0)
+        return board;
+    uint32_t canonical = board;
+    uint32_t mirrored = mirror_board(board);
+    if ((symmetries & SYMMETRY_MIRROR) && mirrored < canonical)
+        canonical = mirrored;
+    if ((symmetries & SYMMETRY_MIRROR_SWAP) && swap_colours(mirrored) < canonical)
+        canonical = swap_colours(mirrored);
+    return canonical;
+}
+#pragma endregion
+#else
+// The mirror image is a symmetry of the built-in board only
+static inline int board_symmetries(board_t board, int whites, int blacks)
+{
+    return 0;
+}
+
+static inline board_t canonical_board(board_t board, int symmetries)
+{
+    return board;
+}
+#endif // HAS_BUILTIN_BOARD
+
+// Writes every board reachable in one move into children[] (with the move
+// that produced it) and returns how many there are
+static inline int generate_children(board_t board, const int neighbors[NUM_POSITIONS][4], board_t children[], int moves[])
+{
+#ifdef HAS_BUILTIN_BOARD
+    if (neighbors == board_neighbors)
+        return generate_children_bitboard(board, children, moves);
+#endif
+    return generate_children_generic(board, neighbors, children, moves);
+}
+
+// Applies the move in reverse, giving the board the move was made from
+static inline board_t undo_move(board_t board, int move)
+{
+    int from_offset = cell_offset(move_to(move));
+    board_t piece = (board >> from_offset) & 0b11;
+    return (board & ~((board_t)0b11 << from_offset)) | (piece << cell_offset(move_from(move)));
+}
+
+static inline int count_cells(board_t cells)
+{
+#if BOARD_CELLS <= 16
+    return __builtin_popcount(cells);
+#elif BOARD_CELLS <= 32
+    return __builtin_popcountll(cells);
+#else
+    return __builtin_popcountll((uint64_t)cells) + __builtin_popcountll((uint64_t)(cells >> 64));
+#endif
+}
+
+// Counts the pieces of each colour. Returns 0 when bits outside the board's
+// pairs are set or a pair holds the unused 10 pattern.
+static inline int count_pieces(board_t board, int *whites, int *blacks)
+{
+    if ((board & ~BOARD_MASK) != 0 || ((board >> 1) & ~board & CELL_LOW_BITS) != 0)
+        return 0;
+    *whites = count_cells(board & ~(board >> 1) & CELL_LOW_BITS);
+    *blacks = count_cells(board & (board >> 1) & CELL_LOW_BITS);
+    return 1;
+}
+
+#pragma region Board Ranking
+// Boards are ranked with the combinatorial number system: the white cells are
+// ranked among all positions, then the black cells among the remaining ones.
+// For w white and b black pieces this maps every board onto a dense index in
+// [0, C(n, w) * C(n - w, b)) for n cells, which is what the visited bitmap
+// and the on-disk distance tables are indexed by. Ranks are 32-bit: every
+// piece count fits up to 16 cells, and larger builds only rank piece counts
+// with at most MAX_RANKED_STATES boards.
+#define MAX_RANKED_STATES UINT32_MAX
+
+static rank_t binomial[NUM_POSITIONS + 1][NUM_POSITIONS + 1];
+
+// rank_board reads the board RANK_CHUNK_CELLS cells at a time, A first, and
+// looks up what each chunk adds to the white and black ranks. A chunk's white
+// part depends on the chunk and the whites before it, its black part on the
+// cells before it that are free of whites and the blacks before it. The board
+// is shifted left so that it splits into whole chunks. The tables grow with
+// the square of the cell count, so wider builds read two cells at a time.
+#ifndef RANK_CHUNK_CELLS
+#if BOARD_CELLS <= 16
+#define RANK_CHUNK_CELLS 4
+#else
+#define RANK_CHUNK_CELLS 2
+#endif
+#endif
+#define RANK_CHUNK_VALUES (1 << (2 * RANK_CHUNK_CELLS))
+#define RANK_CHUNKS ((NUM_POSITIONS + RANK_CHUNK_CELLS - 1) / RANK_CHUNK_CELLS)
+
+static rank_t rank_white_part[RANK_CHUNKS][NUM_POSITIONS + 1][RANK_CHUNK_VALUES];
+static rank_t rank_black_part[NUM_POSITIONS + 1][NUM_POSITIONS + 1][RANK_CHUNK_VALUES];
+static uint8_t chunk_whites[RANK_CHUNK_VALUES];
+static uint8_t chunk_blacks[RANK_CHUNK_VALUES];
+
+static inline void init_binomials()
+{
+    for (int n = 0; n <= NUM_POSITIONS; n++)
+    {
+        binomial[n][0] = 1;
+        for (int k = 1; k <= n; k++)
+        {
+            binomial[n][k] = binomial[n - 1][k - 1] + (k < n ? binomial[n - 1][k] : 0);
+        }
+        for (int k = n + 1; k <= NUM_POSITIONS; k++)
+        {
+            binomial[n][k] = 0;
+        }
+    }
+
+    for (int value = 0; value < RANK_CHUNK_VALUES; value++)
+    {
+        int whites = 0, blacks = 0;
+        for (int c = 0; c < RANK_CHUNK_CELLS; c++)
+        {
+            int pair = (value >> (2 * (RANK_CHUNK_CELLS - 1 - c))) & 0b11;
+            whites += pair == 0b01;
+            blacks += pair == 0b11;
+        }
+        chunk_whites[value] = whites;
+        chunk_blacks[value] = blacks;
+
+        // Combinations that cannot occur on a board are left at 0
+        for (int chunk = 0; chunk < RANK_CHUNKS; chunk++)
+        {
+            for (int seen = 0; seen <= NUM_POSITIONS; seen++)
+            {
+                rank_t part = 0;
+                int k = seen;
+                for (int c = 0; c < RANK_CHUNK_CELLS; c++)
+                {
+                    int cell = chunk * RANK_CHUNK_CELLS + c;
+                    if (((value >> (2 * (RANK_CHUNK_CELLS - 1 - c))) & 0b11) == 0b01 && cell < NUM_POSITIONS &&
+                        k < NUM_POSITIONS)
+                        part += binomial[cell][++k];
+                }
+                rank_white_part[chunk][seen][value] = part;
+            }
+        }
+        for (int free_cells = 0; free_cells <= NUM_POSITIONS; free_cells++)
+        {
+            for (int seen = 0; seen <= NUM_POSITIONS; seen++)
+            {
+                rank_t part = 0;
+                int k = seen, index = free_cells;
+                for (int c = 0; c < RANK_CHUNK_CELLS && index <= NUM_POSITIONS; c++)
+                {
+                    int pair = (value >> (2 * (RANK_CHUNK_CELLS - 1 - c))) & 0b11;
+                    if (pair == 0b11 && k < NUM_POSITIONS)
+                        part += binomial[index][++k];
+                    index += pair != 0b01;
+                }
+                rank_black_part[free_cells][seen][value] = part;
+            }
+        }
+    }
+}
+
+// Saturates at the largest rank_t
+static inline rank_t count_states(int whites, int blacks)
+{
+    rank_t count;
+    if (__builtin_mul_overflow(binomial[NUM_POSITIONS][whites], binomial[NUM_POSITIONS - whites][blacks], &count))
+        return ~(rank_t)0;
+    return count;
+}
+
+static inline uint32_t rank_board(board_t board)
+{
+    board_t aligned = board << (2 * (RANK_CHUNKS * RANK_CHUNK_CELLS - NUM_POSITIONS));
+    rank_t white_rank = 0, black_rank = 0;
+    int whites = 0, blacks = 0;
+    for (int chunk = 0; chunk < RANK_CHUNKS; chunk++)
+    {
+        uint32_t value =
+            (uint32_t)(aligned >> (2 * RANK_CHUNK_CELLS * (RANK_CHUNKS - 1 - chunk))) & (RANK_CHUNK_VALUES - 1);
+        white_rank += rank_white_part[chunk][whites][value];
+        // Black cells are indexed among the cells not taken by white pieces
+        black_rank += rank_black_part[chunk * RANK_CHUNK_CELLS - whites][blacks][value];
+        whites += chunk_whites[value];
+        blacks += chunk_blacks[value];
+    }
+    return (uint32_t)(white_rank * binomial[NUM_POSITIONS - whites][blacks] + black_rank);
+}
+
+static inline board_t unrank_board(uint32_t rank, int whites, int blacks)
+{
+    rank_t black_states = binomial[NUM_POSITIONS - whites][blacks];
+    rank_t white_rank = rank / black_states;
+    rank_t black_rank = rank % black_states;
+    board_t board = 0;
+
+    // Largest cells first: the k-th white sits at the largest c with C(c, k) <= rank
+    int cell = NUM_POSITIONS - 1;
+    for (int k = whites; k > 0; k--)
+    {
+        while (binomial[cell][k] > white_rank)
+            cell--;
+        white_rank -= binomial[cell][k];
+        board |= (board_t)0b01 << (2 * (NUM_POSITIONS - 1 - cell));
+        cell--;
+    }
+
+    // Blacks pick an index among the free cells, counted from A
+    int free_cells[NUM_POSITIONS];
+    int free_count = 0;
+    for (int i = 0; i < NUM_POSITIONS; i++)
+    {
+        if (((board >> (2 * (NUM_POSITIONS - 1 - i))) & 0b01) == 0)
+            free_cells[free_count++] = i;
+    }
+    int index = free_count - 1;
+    for (int k = blacks; k > 0; k--)
+    {
+        while (binomial[index][k] > black_rank)
+            index--;
+        black_rank -= binomial[index][k];
+        board |= (board_t)0b11 << (2 * (NUM_POSITIONS - 1 - free_cells[index]));
+        index--;
+    }
+    return board;
+}
+#pragma endregion
+
+#endif // BOARD_H
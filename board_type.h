@@ -0,0 +1,68 @@
+#ifndef BOARD_TYPE_H
+#define BOARD_TYPE_H
+
+#include <stdint.h>
+
+// The number of cells is fixed when building (make BOARD_CELLS=N, 14 by
+// default: the built-in board) and picks the narrowest word that holds a
+// packed board of two bits per cell. Everything that stores or passes boards
+// uses board_t, so the 14-cell build keeps its single 32-bit word.
+#ifndef BOARD_CELLS
+#define BOARD_CELLS 14
+#endif
+
+#if BOARD_CELLS < 2 || BOARD_CELLS > 64
+#error "BOARD_CELLS must be between 2 and 64"
+#endif
+
+#if BOARD_CELLS <= 16
+typedef uint32_t board_t;
+typedef uint32_t rank_t; // Holds every binomial C(BOARD_CELLS, k)
+#elif BOARD_CELLS <= 32
+typedef uint64_t board_t;
+typedef uint64_t rank_t;
+#else
+__extension__ typedef unsigned __int128 board_t;
+typedef uint64_t rank_t;
+#endif
+
+#define BOARD_BITS (8 * (int)sizeof(board_t))
+
+// Cells are named by one character each, A to N on the built-in board
+#define CELL_NAMES "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"
+
+// A move is the cell it leaves shifted above the cell it enters. Up to 15
+// cells both fit in a nibble, so searches can record moves in a byte with
+// two values left over for their markers.
+#if BOARD_CELLS <= 15
+#define MOVE_SHIFT 4
+typedef uint8_t move_t;
+#else
+#define MOVE_SHIFT 6
+typedef uint16_t move_t;
+#endif
+
+#define MOVE_CELL_MASK ((1 << MOVE_SHIFT) - 1)
+
+static inline int make_move(int from, int to)
+{
+    return (from << MOVE_SHIFT) | to;
+}
+
+static inline int move_from(int move)
+{
+    return (move >> MOVE_SHIFT) & MOVE_CELL_MASK;
+}
+
+static inline int move_to(int move)
+{
+    return move & MOVE_CELL_MASK;
+}
+
+// The same edge walked the other way
+static inline int reverse_move(int move)
+{
+    return make_move(move_to(move), move_from(move));
+}
+
+#endif // BOARD_TYPE_H
@@ -0,0 +1,246 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Client and load generator for `prog --serve`. Puzzles are read one per
+// line in the batch format (or "start goal" packed boards) and sent over a
+// number of connections, each with one request in flight at a time. The
+// latency of every request is recorded and the percentiles are printed once
+// all requests are answered. For example
+//
+//   ./client /tmp/prog.sock --echo puzzles.txt              # answer each puzzle once
+//   ./client /tmp/prog.sock --connections 8 --requests 10000 puzzles.txt
+#define CLIENT_BUFFER 4096
+
+typedef struct ClientConnection
+{
+    int fd;
+    char buffer[CLIENT_BUFFER];
+    size_t length;
+    int request;   // Index of the puzzle in flight, -1 when idle
+    double sent_at; // Nanoseconds
+} ClientConnection;
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int compare_latencies(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, int count, double p)
+{
+    int index = (int)(p * (count - 1) + 0.5);
+    return sorted[index];
+}
+
+static int connect_socket(const char *path)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+    {
+        perror(path);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int send_all(int fd, const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t sent = write(fd, data, length);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return 0;
+        data += sent;
+        length -= sent;
+    }
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *socket_path = NULL;
+    const char *input_path = NULL;
+    int connection_count = 1;
+    long request_count = -1; // One per puzzle unless given
+    int echo = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--connections") == 0 && i + 1 < argc)
+            connection_count = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--requests") == 0 && i + 1 < argc)
+            request_count = atol(argv[++i]);
+        else if (strcmp(argv[i], "--echo") == 0)
+            echo = 1;
+        else if (socket_path == NULL)
+            socket_path = argv[i];
+        else
+            input_path = argv[i];
+    }
+    if (socket_path == NULL || connection_count <= 0)
+    {
+        fprintf(stderr, "Usage: %s <socket path> [--connections N] [--requests N] [--echo] [puzzle file]\n", argv[0]);
+        return 1;
+    }
+
+    FILE *input = input_path == NULL || strcmp(input_path, "-") == 0 ? stdin : fopen(input_path, "r");
+    if (input == NULL)
+    {
+        perror(input_path);
+        return 1;
+    }
+    char **puzzles = NULL;
+    int puzzle_count = 0, puzzle_capacity = 0;
+    char line[256];
+    while (fgets(line, sizeof(line) - 1, input) != NULL) // Room to put back a newline
+    {
+        char first[2];
+        if (sscanf(line, "%1s", first) != 1 || first[0] == '#')
+            continue; // Blank line or comment, which the server would not answer
+        if (puzzle_count == puzzle_capacity)
+        {
+            puzzle_capacity = puzzle_capacity ? 2 * puzzle_capacity : 64;
+            puzzles = (char **)realloc(puzzles, puzzle_capacity * sizeof(char *));
+            if (puzzles == NULL)
+            {
+                perror("Failed to allocate memory for puzzles");
+                return 1;
+            }
+        }
+        size_t length = strcspn(line, "\n");
+        line[length] = '\n';
+        line[length + 1] = '\0';
+        puzzles[puzzle_count++] = strdup(line);
+    }
+    if (input != stdin)
+        fclose(input);
+    if (puzzle_count == 0)
+    {
+        fprintf(stderr, "Error: No puzzles to send.\n");
+        return 1;
+    }
+    if (request_count < 0)
+        request_count = puzzle_count;
+
+    ClientConnection *connections = (ClientConnection *)calloc(connection_count, sizeof(ClientConnection));
+    struct pollfd *polls = (struct pollfd *)calloc(connection_count, sizeof(struct pollfd));
+    double *latencies = (double *)malloc((request_count + 1) * sizeof(double));
+    if (connections == NULL || polls == NULL || latencies == NULL)
+    {
+        perror("Failed to allocate memory for client");
+        return 1;
+    }
+
+    long sent = 0, answered = 0;
+    int errors = 0;
+    double start = now_ns();
+    for (int c = 0; c < connection_count; c++)
+    {
+        connections[c].fd = connect_socket(socket_path);
+        if (connections[c].fd < 0)
+            return 1;
+        connections[c].request = -1;
+        polls[c].fd = connections[c].fd;
+        polls[c].events = POLLIN;
+    }
+
+    while (answered < request_count)
+    {
+        // Every idle connection sends the next puzzle
+        for (int c = 0; c < connection_count; c++)
+        {
+            ClientConnection *connection = &connections[c];
+            if (connection->request >= 0 || sent >= request_count)
+                continue;
+            connection->request = sent % puzzle_count;
+            connection->sent_at = now_ns();
+            if (!send_all(connection->fd, puzzles[connection->request], strlen(puzzles[connection->request])))
+            {
+                perror("write");
+                return 1;
+            }
+            sent++;
+        }
+
+        if (poll(polls, connection_count, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            return 1;
+        }
+        for (int c = 0; c < connection_count; c++)
+        {
+            ClientConnection *connection = &connections[c];
+            if (!(polls[c].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+            ssize_t received = read(connection->fd, connection->buffer + connection->length,
+                                    CLIENT_BUFFER - 1 - connection->length);
+            if (received <= 0)
+            {
+                fprintf(stderr, "Error: Server closed the connection.\n");
+                return 1;
+            }
+            connection->length += received;
+
+            char *newline;
+            while ((newline = memchr(connection->buffer, '\n', connection->length)) != NULL)
+            {
+                size_t reply_length = newline + 1 - connection->buffer;
+                latencies[answered++] = (now_ns() - connection->sent_at) / 1e3;
+                if (strncmp(connection->buffer, "error:", 6) == 0)
+                    errors++;
+                if (echo)
+                    fwrite(connection->buffer, 1, reply_length, stdout);
+                memmove(connection->buffer, newline + 1, connection->length - reply_length);
+                connection->length -= reply_length;
+                connection->request = -1;
+            }
+            if (connection->length == CLIENT_BUFFER - 1)
+            {
+                fprintf(stderr, "Error: Reply too long.\n");
+                return 1;
+            }
+        }
+    }
+    double elapsed = (now_ns() - start) / 1e9;
+
+    qsort(latencies, answered, sizeof(double), compare_latencies);
+    fprintf(stderr, "Requests: %ld over %d connections, %d errors\n", answered, connection_count, errors);
+    fprintf(stderr, "Throughput: %.1f requests/s\n", answered / elapsed);
+    fprintf(stderr, "Latency (us): p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n", percentile(latencies, answered, 0.50),
+            percentile(latencies, answered, 0.90), percentile(latencies, answered, 0.99), latencies[answered - 1]);
+
+    for (int c = 0; c < connection_count; c++)
+        close(connections[c].fd);
+    for (int i = 0; i < puzzle_count; i++)
+        free(puzzles[i]);
+    free(puzzles);
+    free(connections);
+    free(polls);
+    free(latencies);
+    return 0;
+}
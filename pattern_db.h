@@ -0,0 +1,194 @@
+#ifndef PATTERN_DB_H
+#define PATTERN_DB_H
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "board.h"
+
+// A pattern database stores, for every ranked board with a given number of
+// white and black pieces, the exact number of moves until the pieces of one
+// colour (the pattern) sit on their goal cells while the other colour's
+// pieces go anywhere. The other colour still blocks cells, so the value is an
+// admissible bound for any goal sharing the pattern's cells, and one file
+// serves every black goal (or white goal) with those cells.
+//
+// A tablebase is the same file with both colours in the pattern: the exact
+// distance from every board to one goal board, or for small piece counts to
+// every goal board (one block of distances per goal rank).
+//
+// The file is a fixed header followed by one byte per rank, so loading is a
+// single mmap and a lookup is one byte read.
+
+#define PDB_MAGIC 0x31424450u // "PDB1"
+#define PDB_VERSION 1
+#define PDB_UNREACHABLE 0xFF
+#define PDB_MAX_DISTANCE 0xFE
+
+#define PDB_PATTERN_WHITE 0
+#define PDB_PATTERN_BLACK 1
+#define PDB_PATTERN_BOTH 2      // Tablebase for one goal board
+#define PDB_PATTERN_ALL_GOALS 3 // Tablebase for every goal board
+
+typedef struct PatternDbHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t pattern; // Colour whose goal cells the distances lead to, or a tablebase kind
+    uint32_t whites;
+    uint32_t blacks;
+    uint32_t goal_cells;       // Bit i is set when cell 'A' + i is a goal cell (white ones for tablebases)
+    uint32_t size;             // Number of ranked states
+    uint32_t black_goal_cells; // Black goal cells of a one-goal tablebase
+} PatternDbHeader;
+
+typedef struct PatternDb
+{
+    const PatternDbHeader *header;
+    const uint8_t *distances;
+    size_t length;
+} PatternDb;
+
+// Cells holding pieces of the given colour, as a goal_cells mask (which the
+// file format limits to 32 cells)
+static inline uint64_t colour_cells(board_t board, int colour)
+{
+    uint64_t cells = 0;
+    for (int i = 0; i < NUM_POSITIONS; i++)
+    {
+        uint32_t val = (board >> (2 * (NUM_POSITIONS - 1 - i))) & 0b11;
+        if (val == (colour == PDB_PATTERN_WHITE ? 0b01u : 0b11u))
+            cells |= 1ULL << i;
+    }
+    return cells;
+}
+
+static inline int load_pattern_db(const char *path, PatternDb *pdb)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        perror(path);
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(PatternDbHeader))
+    {
+        fprintf(stderr, "Error: %s is not a pattern database.\n", path);
+        close(fd);
+        return 0;
+    }
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        perror(path);
+        return 0;
+    }
+
+    // Lookups index the distances by rank, so the size must be exactly the
+    // number of ranks for the header's piece counts, and an all-goals
+    // tablebase must hold a full block of them for every goal rank
+    const PatternDbHeader *header = (const PatternDbHeader *)data;
+    size_t blocks = header->pattern == PDB_PATTERN_ALL_GOALS ? header->size : 1;
+    if (header->magic != PDB_MAGIC || header->version != PDB_VERSION || header->pattern > PDB_PATTERN_ALL_GOALS ||
+        header->whites > NUM_POSITIONS || header->blacks > NUM_POSITIONS - header->whites ||
+        header->size != count_states(header->whites, header->blacks) ||
+        blocks > (SIZE_MAX - sizeof(PatternDbHeader)) / header->size ||
+        (size_t)st.st_size != sizeof(PatternDbHeader) + blocks * header->size)
+    {
+        fprintf(stderr, "Error: %s is not a pattern database.\n", path);
+        munmap(data, st.st_size);
+        return 0;
+    }
+    pdb->header = header;
+    pdb->distances = (const uint8_t *)(header + 1);
+    pdb->length = st.st_size;
+    return 1;
+}
+
+// Whether a tablebase holds exact distances to this goal board
+static inline int tablebase_covers(const PatternDb *table, board_t board_goal, int whites, int blacks)
+{
+    const PatternDbHeader *header = table->header;
+    if (header == NULL || header->whites != (uint32_t)whites || header->blacks != (uint32_t)blacks)
+        return 0;
+    if (header->pattern == PDB_PATTERN_ALL_GOALS)
+        return 1;
+    return header->pattern == PDB_PATTERN_BOTH && header->goal_cells == colour_cells(board_goal, PDB_PATTERN_WHITE) &&
+           header->black_goal_cells == colour_cells(board_goal, PDB_PATTERN_BLACK);
+}
+
+static inline int tablebase_distance(const PatternDb *table, board_t board_goal, board_t board)
+{
+    if (table->header->pattern == PDB_PATTERN_ALL_GOALS)
+        return table->distances[(size_t)rank_board(board_goal) * table->header->size + rank_board(board)];
+    return table->distances[rank_board(board)];
+}
+
+static inline void unload_pattern_db(PatternDb *pdb)
+{
+    if (pdb->header != NULL)
+        munmap((void *)pdb->header, pdb->length);
+    pdb->header = NULL;
+    pdb->distances = NULL;
+    pdb->length = 0;
+}
+
+// Breadth-first search from all source boards at once over the ranked state
+// space. Moves are reversible, so the layer a board lands in is its distance
+// to the nearest source. Distances beyond PDB_MAX_DISTANCE are clamped, which
+// keeps them admissible.
+static inline int compute_distances(const board_t *sources, uint32_t source_count, int whites, int blacks,
+                                    const int neighbors[NUM_POSITIONS][4], uint8_t *distances)
+{
+    uint32_t size = count_states(whites, blacks);
+    board_t *queue = (board_t *)malloc(size * sizeof(board_t));
+    if (queue == NULL)
+    {
+        perror("Failed to allocate memory for distance search");
+        return 0;
+    }
+    memset(distances, PDB_UNREACHABLE, size);
+
+    uint32_t head = 0, tail = 0;
+    for (uint32_t i = 0; i < source_count; i++)
+    {
+        uint32_t rank = rank_board(sources[i]);
+        if (distances[rank] == PDB_UNREACHABLE)
+        {
+            distances[rank] = 0;
+            queue[tail++] = sources[i];
+        }
+    }
+
+    board_t children[MAX_CHILDREN];
+    int moves[MAX_CHILDREN];
+    while (head < tail)
+    {
+        board_t board = queue[head++];
+        int distance = distances[rank_board(board)];
+        int next = distance < PDB_MAX_DISTANCE ? distance + 1 : PDB_MAX_DISTANCE;
+        int count = generate_children(board, neighbors, children, moves);
+        for (int i = 0; i < count; i++)
+        {
+            uint32_t rank = rank_board(children[i]);
+            if (distances[rank] == PDB_UNREACHABLE)
+            {
+                distances[rank] = next;
+                queue[tail++] = children[i];
+            }
+        }
+    }
+
+    free(queue);
+    return 1;
+}
+
+#endif // PATTERN_DB_H
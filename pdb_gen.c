@@ -0,0 +1,108 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "board.h"
+#include "pattern_db.h"
+
+#ifndef HAS_BUILTIN_BOARD
+#error "pdb_gen only knows the built-in board (BOARD_CELLS=14)"
+#endif
+
+// Builds a pattern database for prog_bin.c (see pattern_db.h). For example
+//
+//   ./pdb_gen white IJKL 4 white_IJKL_4.pdb
+//
+// gives the moves needed to bring four white pieces onto IJKL with four
+// black pieces on the board, wherever those black pieces end up.
+int main(int argc, char *argv[])
+{
+    if (argc != 5)
+    {
+        fprintf(stderr, "Usage: %s <white|black> <goal cells> <other colour count> <output file>\n", argv[0]);
+        return 1;
+    }
+
+    int pattern;
+    if (strcmp(argv[1], "white") == 0)
+        pattern = PDB_PATTERN_WHITE;
+    else if (strcmp(argv[1], "black") == 0)
+        pattern = PDB_PATTERN_BLACK;
+    else
+    {
+        fprintf(stderr, "Error: Pattern colour must be white or black.\n");
+        return 1;
+    }
+
+    const char *goal = argv[2];
+    uint32_t goal_cells = 0;
+    for (int i = 0; goal[i] != '\0'; i++)
+    {
+        if (goal[i] < 'A' || goal[i] > 'N')
+        {
+            fprintf(stderr, "Error: Invalid goal position: %c\n", goal[i]);
+            return 1;
+        }
+        if (goal_cells & (1u << (goal[i] - 'A')))
+        {
+            fprintf(stderr, "Error: Duplicate goal positions.\n");
+            return 1;
+        }
+        goal_cells |= 1u << (goal[i] - 'A');
+    }
+
+    int pattern_count = strlen(goal);
+    int other_count = atoi(argv[3]);
+    if (pattern_count == 0 || other_count < 0 || pattern_count + other_count > NUM_POSITIONS)
+    {
+        fprintf(stderr, "Error: Piece counts do not fit on the board.\n");
+        return 1;
+    }
+    int whites = pattern == PDB_PATTERN_WHITE ? pattern_count : other_count;
+    int blacks = pattern == PDB_PATTERN_WHITE ? other_count : pattern_count;
+
+    init_binomials();
+    uint32_t size = count_states(whites, blacks);
+    uint32_t *sources = (uint32_t *)malloc(size * sizeof(uint32_t));
+    uint8_t *distances = (uint8_t *)malloc(size);
+    if (sources == NULL || distances == NULL)
+    {
+        perror("Failed to allocate memory for pattern database");
+        return 1;
+    }
+
+    // Every board with the pattern colour on its goal cells is a goal
+    uint32_t source_count = 0;
+    for (uint32_t rank = 0; rank < size; rank++)
+    {
+        uint32_t board = unrank_board(rank, whites, blacks);
+        if (colour_cells(board, pattern) == goal_cells)
+            sources[source_count++] = board;
+    }
+
+    if (!compute_distances(sources, source_count, whites, blacks, board_neighbors, distances))
+        return 1;
+
+    PatternDbHeader header = {PDB_MAGIC, PDB_VERSION, pattern, whites, blacks, goal_cells, size, 0};
+    FILE *file = fopen(argv[4], "wb");
+    if (file == NULL)
+    {
+        perror(argv[4]);
+        return 1;
+    }
+    if (fwrite(&header, sizeof(header), 1, file) != 1 || fwrite(distances, 1, size, file) != size)
+    {
+        perror(argv[4]);
+        fclose(file);
+        return 1;
+    }
+    fclose(file);
+
+    printf("Wrote %u states (%u goal boards) to %s\n", size, source_count, argv[4]);
+    free(sources);
+    free(distances);
+    return 0;
+}
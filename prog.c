@@ -1,9 +1,16 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <time.h>
+#include <sys/resource.h>
+
+#include "prog.h"
 
 #define QUEUE_SIZE 300000
 #define NODE_NUM 14
@@ -20,8 +27,19 @@ typedef struct Node
     bool color;
     bool occupied;
     struct Node *neighbors[3]; // Pointers to adjacent nodes
+    uint64_t zobrist[2];       // Hash keys of a white and a black piece here
 } Node;
 
+// The splitmix64 finalizer, to spread the bits of the Zobrist seeds
+static uint64_t mixBits(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
 Node *createNode(char label)
 {
     Node *newNode = (Node *)malloc(sizeof(Node));
@@ -36,6 +54,9 @@ Node *createNode(char label)
     newNode->neighbors[0] = NULL;
     newNode->neighbors[1] = NULL;
     newNode->neighbors[2] = NULL;
+    // Derived from the label, so every board hashes a state the same way
+    newNode->zobrist[0] = mixBits(0x9E3779B97F4A7C15ULL * (2 * (uint64_t)label + 1));
+    newNode->zobrist[1] = mixBits(0x9E3779B97F4A7C15ULL * (2 * (uint64_t)label + 2));
     return newNode;
 }
 // --- End of Node Structure ---
@@ -48,124 +69,197 @@ void setBoardState(Node *board[], const char *whiteNewPos, const char *blackNewP
 char *getPiecesPosition(Node *board[]);
 #pragma endregion
 
+#pragma region Arena
+// --- Arena ---
+// Hash entries and queue nodes are carved out of large slabs, and everything
+// a search allocated is released by one freeArena call at the end, instead
+// of a malloc and a free per state
+#define ARENA_SLAB_SIZE (1 << 20)
+#define ARENA_ALIGN 16
+
+typedef struct ArenaSlab
+{
+    struct ArenaSlab *next;
+    size_t used;
+    char data[];
+} ArenaSlab;
+
+typedef struct Arena
+{
+    ArenaSlab *slabs; // The newest first
+} Arena;
+
+void initArena(Arena *arena)
+{
+    arena->slabs = NULL;
+}
+
+// Returns size bytes that stay valid until freeArena, or NULL when memory runs out
+void *arenaAlloc(Arena *arena, size_t size)
+{
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    ArenaSlab *slab = arena->slabs;
+    if (slab == NULL || slab->used + size > ARENA_SLAB_SIZE)
+    {
+        slab = (ArenaSlab *)malloc(offsetof(ArenaSlab, data) + ARENA_SLAB_SIZE);
+        if (slab == NULL)
+        {
+            perror("Failed to allocate memory for arena");
+            return NULL;
+        }
+        slab->next = arena->slabs;
+        slab->used = 0;
+        arena->slabs = slab;
+    }
+    void *memory = slab->data + slab->used;
+    slab->used += size;
+    return memory;
+}
+
+void freeArena(Arena *arena)
+{
+    while (arena->slabs != NULL)
+    {
+        ArenaSlab *next = arena->slabs->next;
+        free(arena->slabs);
+        arena->slabs = next;
+    }
+}
+// --- End of Arena ---
+#pragma endregion
+
 #pragma region Hash Table
 // --- Hash Table ---
 #define TABLE_SIZE 1000000
 
 typedef struct HashEntry
 {
-    unsigned long key;      // Hash of the board state
-    char *whitePos;         // to store white pieces position
-    char *blackPos;         // to store black pieces position
-    struct HashEntry *next; // For collision handling (chaining)
+    uint64_t key;                // Hash of the board state
+    char whitePos[NODE_NUM + 1]; // to store white pieces position
+    char blackPos[NODE_NUM + 1]; // to store black pieces position
+    struct HashEntry *next;      // For collision handling (chaining)
 } HashEntry;
 
-HashEntry *hashTable[TABLE_SIZE]; // The hash table
-
-unsigned long hashBoardState(Node *board[], int nodeNum)
+// Each solvePuzzle call owns its table, so calls on different threads do
+// not share one
+typedef struct HashTable
+{
+    HashEntry *buckets[TABLE_SIZE];
+    Arena *arena;              // Holds the entries
+    unsigned long chainProbes; // Entries compared by lookupBoardState
+    int longestChain;          // Most entries compared by one lookup
+} HashTable;
+
+// The Zobrist hash: the XOR of the keys of every piece on its node. Moving
+// a piece from one node to another XORs out its key there and XORs in the
+// one at its new node, so children are hashed from their parent in two XORs.
+uint64_t hashBoardState(Node *board[], int nodeNum)
 {
-    unsigned long hash = 0;
-    unsigned long prime = 53; // Or any other suitable prime number
+    uint64_t hash = 0;
     for (int i = 0; i < nodeNum; i++)
     {
-        unsigned long cellValue = 0;
         if (board[i]->occupied)
         {
-            cellValue = (board[i]->color == 0) ? 1UL : 2UL;
+            hash ^= board[i]->zobrist[board[i]->color];
         }
-        hash = hash * prime + cellValue;
     }
     return hash;
 }
 
-// Function to initialize the hash table
-void initHashTable()
+// Function to create an empty hash table
+HashTable *initHashTable(Arena *arena)
 {
-    for (int i = 0; i < TABLE_SIZE; i++)
+    HashTable *table = (HashTable *)calloc(1, sizeof(HashTable));
+    if (table == NULL)
     {
-        hashTable[i] = NULL;
+        perror("Failed to allocate memory for hash table");
+        return NULL;
     }
+    table->arena = arena;
+    return table;
 }
 
-// Function to insert a board state into the hash table
-void insertBoardState(unsigned long key, const char *whitePos,
+// Function to insert a board state into the hash table. Returns false when
+// the arena runs out.
+bool insertBoardState(HashTable *table, uint64_t key, const char *whitePos,
                       const char *blackPos)
 {
     int index = key % TABLE_SIZE;
-    HashEntry *newEntry = (HashEntry *)malloc(sizeof(HashEntry));
+    HashEntry *newEntry = (HashEntry *)arenaAlloc(table->arena, sizeof(HashEntry));
     if (newEntry == NULL)
     {
-        perror("Failed to allocate memory for hash entry");
-        return;
+        return false;
     }
     newEntry->key = key;
-    newEntry->whitePos = strdup(whitePos); // copy the string
-    newEntry->blackPos = strdup(blackPos); // copy the string
+    strcpy(newEntry->whitePos, whitePos); // copy the string
+    strcpy(newEntry->blackPos, blackPos); // copy the string
     newEntry->next = NULL;
 
     // Handle collision (chaining)
-    if (hashTable[index] == NULL)
+    if (table->buckets[index] == NULL)
     {
-        hashTable[index] = newEntry;
+        table->buckets[index] = newEntry;
     }
     else
     {
-        HashEntry *current = hashTable[index];
+        HashEntry *current = table->buckets[index];
         while (current->next != NULL)
         {
             current = current->next;
         }
         current->next = newEntry;
     }
+    return true;
 }
 
 // Function to lookup a board state in the hash table
-bool lookupBoardState(unsigned long key, const char *whitePos,
+bool lookupBoardState(HashTable *table, uint64_t key, const char *whitePos,
                       const char *blackPos)
 {
     int index = key % TABLE_SIZE;
-    HashEntry *current = hashTable[index];
+    HashEntry *current = table->buckets[index];
+    int probes = 0;
+    bool found = false;
 
     while (current != NULL)
     {
+        probes++;
         if (current->key == key && strcmp(current->whitePos, whitePos) == 0 &&
             strcmp(current->blackPos, blackPos) == 0)
         {
-            return true; // Board state found
+            found = true; // Board state found
+            break;
         }
         current = current->next;
     }
-    return false; // Board state not found
+    table->chainProbes += probes;
+    if (probes > table->longestChain)
+    {
+        table->longestChain = probes;
+    }
+    return found;
 }
 
-// Function to free the memory allocated for the hash table
-void freeHashTable()
+// Function to free the memory allocated for the hash table. The entries
+// go with its arena.
+void freeHashTable(HashTable *table)
 {
-    for (int i = 0; i < TABLE_SIZE; i++)
-    {
-        HashEntry *current = hashTable[i];
-        while (current != NULL)
-        {
-            HashEntry *temp = current;
-            current = current->next;
-            free(temp->whitePos);
-            free(temp->blackPos);
-            free(temp);
-        }
-        hashTable[i] = NULL;
-    }
+    free(table);
 }
 // --- End of Hash Table ---
 #pragma endregion
 
 #pragma region Queue
 // --- Queue Implementation ---
+// A state that has been seen but not expanded yet, with the move that
+// first reached it
 typedef struct QueueData
 {
     char whitePos[NODE_NUM + 1];
     char blackPos[NODE_NUM + 1];
     char move[3];
     int predecessor;
+    uint64_t hash;
 } QueueData;
 
 typedef struct QueueNode
@@ -174,18 +268,24 @@ typedef struct QueueNode
     struct QueueNode *next;
 } QueueNode;
 
+// Dequeued nodes go on a free list for the next enqueues, so the arena only
+// grows to the longest the queue gets
 typedef struct DynamicLinkedQueue
 {
     QueueNode *head;
     QueueNode *tail;
     int size;
+    QueueNode *freeNodes;
+    Arena *arena;
 } DynamicLinkedQueue;
 
-void initQueue(DynamicLinkedQueue *queue)
+void initQueue(DynamicLinkedQueue *queue, Arena *arena)
 {
     queue->head = NULL;
     queue->tail = NULL;
     queue->size = 0;
+    queue->freeNodes = NULL;
+    queue->arena = arena;
 }
 
 bool isQueueEmpty(DynamicLinkedQueue *queue)
@@ -193,16 +293,19 @@ bool isQueueEmpty(DynamicLinkedQueue *queue)
     return queue->head == NULL;
 }
 
-bool enqueueQueue(DynamicLinkedQueue *queue, Node *board[], const char *whitePos, const char *blackPos,
-                  const char *move, int currentIteration, int whiteLen, int blackLen)
+bool enqueueQueue(DynamicLinkedQueue *queue, const char *whitePos, const char *blackPos, const char *move,
+                  int currentIteration, uint64_t hash, int whiteLen, int blackLen)
 {
-    QueueNode *newNode = (QueueNode *)malloc(sizeof(QueueNode));
-    if (newNode == NULL)
+    QueueNode *newNode = queue->freeNodes;
+    if (newNode != NULL)
+    {
+        queue->freeNodes = newNode->next;
+    }
+    else if ((newNode = (QueueNode *)arenaAlloc(queue->arena, sizeof(QueueNode))) == NULL)
     {
-        perror("Failed to allocate memory for queue node");
         return false;
     }
-    
+
     strncpy(newNode->data.whitePos, whitePos, whiteLen);
     newNode->data.whitePos[whiteLen] = '\0'; // Ensure null-termination
     strncpy(newNode->data.blackPos, blackPos, blackLen);
@@ -210,6 +313,7 @@ bool enqueueQueue(DynamicLinkedQueue *queue, Node *board[], const char *whitePos
     strncpy(newNode->data.move, move, 2);
     newNode->data.move[2] = '\0'; // Ensure null-termination
     newNode->data.predecessor = currentIteration;
+    newNode->data.hash = hash;
     newNode->next = NULL;
 
     if (isQueueEmpty(queue))
@@ -229,7 +333,7 @@ bool enqueueQueue(DynamicLinkedQueue *queue, Node *board[], const char *whitePos
 
 QueueData dequeueQueue(DynamicLinkedQueue *queue)
 {
-    QueueData emptyData = {"", "", "", -1};
+    QueueData emptyData = {"", "", "", -1, 0};
     if (isQueueEmpty(queue))
     {
         return emptyData; // Queue empty
@@ -241,7 +345,8 @@ QueueData dequeueQueue(DynamicLinkedQueue *queue)
     {
         queue->tail = NULL; // Reset tail if the queue is empty
     }
-    free(temp);
+    temp->next = queue->freeNodes;
+    queue->freeNodes = temp;
     queue->size--;
     return data;
 }
@@ -261,108 +366,91 @@ void printQueue(DynamicLinkedQueue *queue)
     printf("End of Queue\n");
 }
 
+// Empties the queue; its nodes go with its arena
 void freeQueue(DynamicLinkedQueue *queue)
 {
-    QueueNode *current = queue->head;
-    while (current != NULL)
-    {
-        QueueNode *temp = current;
-        current = current->next;
-        free(temp);
-    }
     queue->head = NULL;
     queue->tail = NULL;
     queue->size = 0;
+    queue->freeNodes = NULL;
 }
 
 typedef struct Predecessor
 {
     char move[3];
     int predecessor;
+    int depth;
 } Predecessor;
 
-void reconstructPath(Predecessor *predecessors, int goalIndex, int path[], int *pathLength)
+// Writes the moves from the start to predecessors[goalIndex] into moves,
+// including the "--" entry of the start state. Returns the number written,
+// or -1 when the path does not fit in maxMoves.
+int reconstructPath(Predecessor *predecessors, int goalIndex, char moves[][3], int maxMoves)
 {
-    if (predecessors == NULL || path == NULL || pathLength == NULL)
+    if (predecessors == NULL || moves == NULL)
     {
         fprintf(stderr, "[Error]: Null pointer passed to reconstructPath.\n");
-        return;
+        return -1;
     }
-    // Initialize path length
 
     // Reconstruct the path from the goal index to the start
-    int currentIndex = goalIndex;
-    int index = 0;
-    while (currentIndex != -1)
+    int pathLength = 0;
+    for (int currentIndex = goalIndex; currentIndex != -1; currentIndex = predecessors[currentIndex].predecessor)
     {
-        path[index] = currentIndex;
-        currentIndex = predecessors[currentIndex].predecessor;
-        index++;
+        pathLength++;
     }
-
-    *pathLength = index;
-
-    // Reverse the path to get it from start to goal
-    for (int i = 0; i < *pathLength / 2; i++)
+    if (pathLength > maxMoves)
     {
-        int temp = path[i];
-        path[i] = path[*pathLength - 1 - i];
-        path[*pathLength - 1 - i] = temp;
+        fprintf(stderr, "[Error]: Path of %d moves does not fit.\n", pathLength);
+        return -1;
     }
 
-    // Print the reconstructed path
-    printf("Reconstructed Path:\n");
-    for (int i = 0; i < *pathLength; i++)
+    // Fill it from the end to get it from start to goal
+    int index = pathLength;
+    for (int currentIndex = goalIndex; currentIndex != -1; currentIndex = predecessors[currentIndex].predecessor)
     {
-#ifdef SIMPLE
-        printf("%s\n", predecessors[path[i]].move);
-#else
-        printf("Move: %s, Predecessor: %d\n", predecessors[path[i]].move, predecessors[path[i]].predecessor);
-#endif // !SIMPLE
+        index--;
+        strncpy(moves[index], predecessors[currentIndex].move, 3);
     }
+    return pathLength;
 }
 
-void printBoardForSolution(Node *board[], const char *whitePos, const char *blackPos, int path[], int pathLength, Predecessor *predecessors)
+void printBoardForSolution(Node *board[], const char *whitePos, const char *blackPos, char moves[][3], int pathLength)
 {
     setBoardState(board, whitePos, blackPos);
 
     printf("Path to solution:\n");
     for (int i = 0; i < pathLength; i++)
     {
-        int index = path[i];
-        char prevPos = predecessors[index].move[0];
-        char newPos = predecessors[index].move[1];
+        char prevPos = moves[i][0];
+        char newPos = moves[i][1];
 
         Node *prevNode = NULL;
-        Node *newNode = NULL;
-        // Find the previous and new nodes
+        // Find the previous node
         for (int i = 0; i < NODE_NUM; i++)
         {
             if (board[i]->label == prevPos)
             {
                 prevNode = board[i];
             }
-            if (board[i]->label == newPos)
-            {
-                newNode = board[i];
-            }
+        }
+        if (prevNode == NULL)
+        {
+            printBoard(board); // The "--" entry of the start state
+            continue;
         }
 
         for (int i = 0; i < NODE_NUM; i++)
         {
-            if (board[i]->label == prevPos)
-            {
-                board[i]->occupied = false;
-            }
             if (board[i]->label == newPos)
             {
                 board[i]->occupied = true;
                 board[i]->color = prevNode->color; // Set the color based on the piece
             }
         }
+        prevNode->occupied = false;
 
         printBoard(board);
-        // printf("Move: %s, Predecessor: %d\n", predecessors[index].move, predecessors[index].predecessor);
     }
 }
 
@@ -469,11 +557,31 @@ void setBoardState(Node *board[], const char *whiteNewPos, const char *blackNewP
     // printf("Board state set.\n");
 }
 
-void generateNextStates(Node *board[], DynamicLinkedQueue *queue, int currentIteration)
+// Writes pos with the piece on from moved to to, keeping the labels in
+// alphabetical order as getPositions would list them
+static void movePieceLabel(const char *pos, char from, char to, char *out)
+{
+    int length = 0;
+    for (; *pos != '\0'; pos++)
+    {
+        if (*pos != from)
+        {
+            out[length++] = *pos;
+        }
+    }
+    int i = length;
+    while (i > 0 && out[i - 1] > to)
+    {
+        out[i] = out[i - 1];
+        i--;
+    }
+    out[i] = to;
+    out[length + 1] = '\0';
+}
+
+// Writes the labels of the white and the black pieces, in board order
+static void getPositions(Node *board[], char *whitePos, char *blackPos)
 {
-    // Get the current positions of white and black pieces from the board
-    char currentWhitePos[NODE_NUM + 1] = {0};
-    char currentBlackPos[NODE_NUM + 1] = {0};
     int whiteIndex = 0, blackIndex = 0;
     for (int i = 0; i < NODE_NUM; i++)
     {
@@ -481,49 +589,335 @@ void generateNextStates(Node *board[], DynamicLinkedQueue *queue, int currentIte
         {
             if (board[i]->color == 0) // White
             {
-                currentWhitePos[whiteIndex++] = board[i]->label;
+                whitePos[whiteIndex++] = board[i]->label;
             }
             else // Black
             {
-                currentBlackPos[blackIndex++] = board[i]->label;
+                blackPos[blackIndex++] = board[i]->label;
             }
         }
     }
-    currentWhitePos[whiteIndex] = '\0';
-    currentBlackPos[blackIndex] = '\0';
+    whitePos[whiteIndex] = '\0';
+    blackPos[blackIndex] = '\0';
+}
+
+// Enqueues the children of the board that are not in the table yet and
+// inserts them there, so duplicates are dropped when they are generated and
+// every state enters the queue at most once. hash is the board's hash (see
+// hashBoardState). Returns the number of next states generated, or -1 when
+// one cannot be stored.
+int generateNextStates(Node *board[], uint64_t hash, HashTable *table, DynamicLinkedQueue *queue,
+                       int currentIteration, SolverStats *stats)
+{
+    // Get the current positions of white and black pieces from the board
+    char currentWhitePos[NODE_NUM + 1];
+    char currentBlackPos[NODE_NUM + 1];
+    getPositions(board, currentWhitePos, currentBlackPos);
+    int whiteLen = strlen(currentWhitePos);
+    int blackLen = strlen(currentBlackPos);
 
     // Generate next states based on the current board state
+    char newWhitePos[NODE_NUM + 1];
+    char newBlackPos[NODE_NUM + 1];
+    int generated = 0;
     for (int i = 0; i < NODE_NUM; i++)
     {
         if (board[i]->occupied)
         {
-            for (int j = 0; j < MAX_NEIGHBORS && board[i]->neighbors[j] != NULL; j++)
+            Node *from = board[i];
+            for (int j = 0; j < MAX_NEIGHBORS && from->neighbors[j] != NULL; j++)
             {
                 // If neighbor is empty, we can move there
-                if (!board[i]->neighbors[j]->occupied)
+                Node *to = from->neighbors[j];
+                if (to->occupied)
+                {
+                    continue;
+                }
+                generated++;
+                uint64_t newHash = hash ^ from->zobrist[from->color] ^ to->zobrist[from->color];
+                if (from->color == 0)
+                {
+                    movePieceLabel(currentWhitePos, from->label, to->label, newWhitePos);
+                    strcpy(newBlackPos, currentBlackPos);
+                }
+                else
                 {
-                    char move[3] = {board[i]->label, board[i]->neighbors[j]->label, '\0'};
+                    strcpy(newWhitePos, currentWhitePos);
+                    movePieceLabel(currentBlackPos, from->label, to->label, newBlackPos);
+                }
 
-                    enqueueQueue(queue, board, currentWhitePos, currentBlackPos, move, currentIteration,
-                                 strlen(currentWhitePos), strlen(currentBlackPos));
+                // Check if the new state is already in the hash table
+                if (lookupBoardState(table, newHash, newWhitePos, newBlackPos))
+                {
+#ifndef SIMPLE
+                    printf("[Skipping]: State %s %s already visited.\n", newWhitePos, newBlackPos);
+#endif // !SIMPLE
+                    stats->duplicatesRejected++;
+                    continue;
+                }
+                char move[3] = {from->label, to->label, '\0'};
+                if (!insertBoardState(table, newHash, newWhitePos, newBlackPos) ||
+                    !enqueueQueue(queue, newWhitePos, newBlackPos, move, currentIteration, newHash, whiteLen, blackLen))
+                {
+                    return -1;
                 }
             }
         }
     }
+    return generated;
+}
+
+#pragma endregion
+
+#pragma region Solver
+// The board graph as the edge list of a topology file (see board.h), one
+// pair of cell labels per edge
+static const char *boardEdges = "AB BC CD DE EF FG HI IJ JK KL LM MN CL";
+
+// Adds a neighbor to a node, keeping its neighbors in label order so that
+// moves are generated in the same order as in prog_bin.c
+static void linkNode(Node *node, Node *neighbor)
+{
+    int j = 0;
+    while (j < MAX_NEIGHBORS && node->neighbors[j] != NULL && node->neighbors[j]->label < neighbor->label)
+    {
+        j++;
+    }
+    for (int k = MAX_NEIGHBORS - 1; k > j; k--)
+    {
+        node->neighbors[k] = node->neighbors[k - 1];
+    }
+    node->neighbors[j] = neighbor;
+}
+
+// Creates the nodes and links them into the board graph
+void initBoard(Node *board[])
+{
+    for (int i = 0; i < NODE_NUM; i++)
+    {
+        board[i] = createNode('A' + i);
+    }
+
+    // --- Define Neighbors ---
+    const char *edge = boardEdges;
+    while (*edge != '\0')
+    {
+        if (*edge == ' ')
+        {
+            edge++;
+            continue;
+        }
+        Node *a = board[edge[0] - 'A'];
+        Node *b = board[edge[1] - 'A'];
+        linkNode(a, b);
+        linkNode(b, a);
+        edge += 2;
+    }
+    // --- End of Neighbors Definition ---
+}
+
+void freeBoard(Node *board[])
+{
+    for (int i = 0; i < NODE_NUM; i++)
+    {
+        free(board[i]);
+        board[i] = NULL;
+    }
+}
+
+double monotonicMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// Counts a state first reached at this depth
+static void addToFrontier(SolverStats *stats, int depth)
+{
+    if (depth >= MAX_STATS_DEPTH)
+    {
+        return;
+    }
+    stats->frontierSizes[depth]++;
+    if (depth >= stats->depthCount)
+    {
+        stats->depthCount = depth + 1;
+    }
 }
 
+int solvePuzzle(const char *whiteStart, const char *blackStart, const char *whiteGoal, const char *blackGoal,
+                char moves[][3], int maxMoves, int *pathLength, SolverStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    double phaseStart = monotonicMs();
+
+    Node *board[NODE_NUM];
+    initBoard(board);
+
+#pragma region Queue and Hash Table Initialization
+    Arena arena;
+    initArena(&arena);
+    DynamicLinkedQueue queue;
+    initQueue(&queue, &arena);
+    HashTable *table = initHashTable(&arena);
+    Predecessor *predecessors = (Predecessor *)malloc(QUEUE_SIZE * sizeof(Predecessor));
+    if (table == NULL || predecessors == NULL)
+    {
+        if (predecessors == NULL)
+            perror("Failed to allocate memory for predecessors");
+        free(table);
+        free(predecessors);
+        freeBoard(board);
+        return -1;
+    }
+    int goalState = -1;
+    bool failed = false;
+    *pathLength = 0;
+    stats->initMs = monotonicMs() - phaseStart;
+    phaseStart = monotonicMs();
 #pragma endregion
 
+    setBoardState(board, whiteStart, blackStart);
+    int iteration = 0;
+
+    // Insert the start state into the hash table
+    char startWhitePos[NODE_NUM + 1];
+    char startBlackPos[NODE_NUM + 1];
+    getPositions(board, startWhitePos, startBlackPos);
+    uint64_t startHash = hashBoardState(board, NODE_NUM);
+    failed = !insertBoardState(table, startHash, startWhitePos, startBlackPos);
+
+    predecessors[0].predecessor = -1;
+    predecessors[0].depth = 0;
+    strncpy(predecessors[0].move, "--", 2);
+    predecessors[0].move[2] = '\0'; // Ensure null-termination
+    addToFrontier(stats, 0);
+
+    if (isGoalState(board, whiteGoal, blackGoal))
+    {
+        goalState = 0;
+        *pathLength = reconstructPath(predecessors, 0, moves, maxMoves);
+    }
+    else if (!failed)
+    {
+        int generated = generateNextStates(board, startHash, table, &queue, iteration, stats);
+        failed = generated < 0;
+        stats->statesGenerated += failed ? 0 : generated;
+        stats->statesExpanded++;
+        stats->peakQueueSize = queue.size;
+    }
+
+    // Every queued state is new, since duplicates were dropped when they
+    // were generated, and its move is known to be valid
+    while (goalState == -1 && !failed && !isQueueEmpty(&queue))
+    {
+#ifndef SIMPLE
+        printf("----------Iteration: %6d----------\n", iteration);
+#endif // !SIMPLE
+
+        QueueData state = dequeueQueue(&queue);
+
+#ifndef SIMPLE
+        printf("Dequeue: %s %s|%s\n", state.whitePos, state.blackPos, state.move);
+#endif // !SIMPLE
+
+        iteration++;
+        predecessors[iteration].predecessor = state.predecessor;
+        predecessors[iteration].depth = predecessors[state.predecessor].depth + 1;
+        memcpy(predecessors[iteration].move, state.move, sizeof(state.move)); // Null-terminated by enqueueQueue
+        addToFrontier(stats, predecessors[iteration].depth);
+
+        // The queued positions are in board order, as the goal must be
+        if (strcmp(state.whitePos, whiteGoal) == 0 && strcmp(state.blackPos, blackGoal) == 0)
+        {
+            goalState = iteration;
+            stats->searchMs = monotonicMs() - phaseStart;
+            phaseStart = monotonicMs();
+            *pathLength = reconstructPath(predecessors, iteration, moves, maxMoves);
+            stats->reconstructMs = monotonicMs() - phaseStart;
+            break;
+        }
+
+        // Generate next states
+        setBoardState(board, state.whitePos, state.blackPos);
+        int generated = generateNextStates(board, state.hash, table, &queue, iteration, stats);
+        if (generated < 0)
+        {
+            failed = true;
+            break;
+        }
+        stats->statesGenerated += generated;
+        stats->statesExpanded++;
+        if (queue.size > stats->peakQueueSize)
+        {
+            stats->peakQueueSize = queue.size;
+        }
+    }
+
+    if (goalState == -1)
+    {
+        stats->searchMs = monotonicMs() - phaseStart;
+    }
+    stats->chainProbes = table->chainProbes;
+    stats->longestChain = table->longestChain;
+
+    phaseStart = monotonicMs();
+    freeQueue(&queue);
+    free(predecessors);
+    freeBoard(board);
+    freeHashTable(table);
+    freeArena(&arena);
+    stats->teardownMs = monotonicMs() - phaseStart;
+
+    if (failed || *pathLength < 0)
+    {
+        *pathLength = 0;
+        return -1;
+    }
+    return goalState != -1;
+}
+// Writes the stats as one line of JSON, with the same keys as prog_bin.c
+void printStats(FILE *out, const SolverStats *stats, double validateMs)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    fprintf(out, "{\"expanded\": %d, \"generated\": %d, \"duplicates\": %d, \"probes\": %lu, \"longest_chain\": %d, "
+                 "\"peak_queue\": %d, \"frontier\": [",
+            stats->statesExpanded, stats->statesGenerated, stats->duplicatesRejected, stats->chainProbes,
+            stats->longestChain, stats->peakQueueSize);
+    for (int i = 0; i < stats->depthCount; i++)
+    {
+        fprintf(out, i ? ", %d" : "%d", stats->frontierSizes[i]);
+    }
+    fprintf(out, "], \"phases_ms\": {\"validate\": %.3f, \"init\": %.3f, \"search\": %.3f, \"reconstruct\": %.3f, "
+                 "\"teardown\": %.3f}, \"peak_rss_kb\": %ld}\n",
+            validateMs, stats->initMs, stats->searchMs, stats->reconstructMs, stats->teardownMs, usage.ru_maxrss);
+}
+#pragma endregion
+
+// Leave main out to link the solver into another program, such as bench.c
+#ifndef NO_MAIN
 int main(int argc, char *argv[])
 {
     clock_t start, end;
     double cpu_time_used;
+    double validateStart = monotonicMs();
 
 #pragma region Error Handling
+    // --stats prints a line of JSON on stderr after the solution
+    bool showStats = false;
+    if (argc > 1 && strcmp(argv[1], "--stats") == 0)
+    {
+        showStats = true;
+        argv[1] = argv[0];
+        argv++;
+        argc--;
+    }
     // Check for correct number of arguments
     if (argc != 5)
     {
-        fprintf(stderr, "Usage: %s <white pieces> <black pieces> <white end> <black end>\n", argv[0]);
+        fprintf(stderr, "Usage: %s [--stats] <white pieces> <black pieces> <white end> <black end>\n", argv[0]);
         return 1;
     }
     // Check for same starting and ending length
@@ -599,270 +993,62 @@ int main(int argc, char *argv[])
             return 1;
         }
     }
+    double validateMs = monotonicMs() - validateStart;
 #pragma endregion
 
-#pragma region Node Initialization
-    // --- Initialize Nodes ---
     Node *board[NODE_NUM];
-    for (int i = 0; i < NODE_NUM; i++)
-    {
-        board[i] = createNode('A' + i);
-    }
-
-    // --- Define Neighbors ---
-    board[0]->neighbors[0] = board[1];   // A neighbor is B
-    board[1]->neighbors[0] = board[0];   // B neighbor is A
-    board[1]->neighbors[1] = board[2];   // B neighbor is C
-    board[2]->neighbors[0] = board[1];   // C neighbor is B
-    board[2]->neighbors[1] = board[3];   // C neighbor is D
-    board[2]->neighbors[2] = board[11];  // C neighbor is L
-    board[3]->neighbors[0] = board[2];   // D neighbor is C
-    board[3]->neighbors[1] = board[4];   // D neighbor is E
-    board[4]->neighbors[0] = board[3];   // E neighbor is D
-    board[4]->neighbors[1] = board[5];   // E neighbor is F
-    board[5]->neighbors[0] = board[4];   // F neighbor is E
-    board[5]->neighbors[1] = board[6];   // F neighbor is G
-    board[6]->neighbors[0] = board[5];   // G neighbor is F
-    board[7]->neighbors[0] = board[8];   // H neighbor is I
-    board[8]->neighbors[0] = board[7];   // I neighbor is H
-    board[8]->neighbors[1] = board[9];   // I neighbor is J
-    board[9]->neighbors[0] = board[8];   // J neighbor is I
-    board[9]->neighbors[1] = board[10];  // J neighbor is K
-    board[10]->neighbors[0] = board[9];  // K neighbor is J
-    board[10]->neighbors[1] = board[11]; // K neighbor is L
-    board[11]->neighbors[0] = board[2];  // L neighbor is C
-    board[11]->neighbors[1] = board[10]; // L neighbor is K
-    board[11]->neighbors[2] = board[12]; // L neighbor is M
-    board[12]->neighbors[0] = board[11]; // M neighbor is L
-    board[12]->neighbors[1] = board[13]; // M neighbor is N
-    board[13]->neighbors[0] = board[12]; // N neighbor is M
-    // --- End of Neighbors Definition ---
-
-#pragma endregion
-
-#pragma region Queue and Hash Table Initialization
-    DynamicLinkedQueue queue;
-    initQueue(&queue);
-    initHashTable();
-    Predecessor predecessors[QUEUE_SIZE];
-    int goalState = -1;
-#pragma endregion
-
-    // printf("Starting positions: White: %s, Black: %s\n", argv[1], argv[2]);
-    char *whitePieces = strdup(argv[1]);
-    char *blackPieces = strdup(argv[2]);
-    int whitePiecesLength = strlen(whitePieces);
-    int blackPiecesLength = strlen(blackPieces);
-
-    setBoardState(board, whitePieces, blackPieces);
-    // printf("Initial Positions: White: %s, Black: %s\n", whitePieces, blackPieces);
-    int iteration = 0;
-
+    initBoard(board);
+    setBoardState(board, argv[1], argv[2]);
     printBoard(board);
-    // Generate current board hash
-    unsigned long currentHash = hashBoardState(board, NODE_NUM);
-    // printf("Current Hash: %lu\n", currentHash);
-    // Check if the current state is already in the hash table
-    if (lookupBoardState(currentHash, whitePieces, blackPieces))
+
+    char(*moves)[3] = malloc(QUEUE_SIZE * sizeof(*moves));
+    if (moves == NULL)
     {
-        printf("State already visited.\n");
-        return 0;
+        perror("Failed to allocate memory for path");
+        return 1;
     }
-    // Insert the current state into the hash table
-    insertBoardState(currentHash, whitePieces, blackPieces);
-    // printf("State inserted into hash table.\n");
-
-    predecessors[0].predecessor = -1;
-    strncpy(predecessors[0].move, "--", 2);
-    predecessors[0].move[2] = '\0'; // Ensure null-termination
-
-    generateNextStates(board, &queue, iteration);
-    // printQueue(&queue);
+    int pathLength = 0;
+    SolverStats stats;
 
     start = clock();
-
-    while (!isQueueEmpty(&queue))
-    {
-    next_iteration:;
-
-#ifndef SIMPLE
-        printf("----------Iteration: %6d----------\n", iteration);
-#endif // !SIMPLE
-
-        QueueData state = dequeueQueue(&queue);
-
-#ifndef SIMPLE
-        printf("Dequeue: %s %s|%s : ", state.whitePos, state.blackPos, state.move);
-#endif // !SIMPLE
-
-        char prevPos = state.move[0];
-        char newPos = state.move[1];
-        // printf("Moving from %c to %c\n", prevPos, newPos);
-
-        setBoardState(board, state.whitePos, state.blackPos);
-
-        Node *prevNode = NULL;
-        Node *newNode = NULL;
-
-        // Find the previous and new nodes and validate move
-        for (int i = 0; i < NODE_NUM; i++)
-        {
-            if (board[i]->label == prevPos)
-            {
-                prevNode = board[i];
-                if (!prevNode->occupied)
-                {
-                    printf("[Skipping]: No piece found at %c\n", prevPos);
-                    goto next_iteration; // Jump to the end of the loop
-                }
-            }
-            else if (board[i]->label == newPos)
-            {
-                newNode = board[i];
-                if (newNode->occupied)
-                {
-                    printf("[Skipping]: %c is already occupied\n", newPos);
-                    goto next_iteration; // Jump to the end of the loop
-                }
-            }
-        }
-
-        if (prevNode == NULL)
-        {
-            printf("[Skipping]: No piece found at %c\n", prevPos);
-            goto next_iteration;
-        }
-        if (newNode == NULL)
-        {
-            printf("[Skipping]: Invalid move to %c\n", newPos);
-            goto next_iteration;
-        }
-
-        bool validMove = false;
-        for (int j = 0; j < 3 && prevNode->neighbors[j] != NULL; j++)
-        {
-            if (prevNode->neighbors[j]->label == newPos)
-            {
-                validMove = true;
-                break;
-            }
-        }
-        if (!validMove)
-        {
-            printf("[Skipping]: Invalid move from %c to %c\n", prevPos, newPos);
-            goto next_iteration;
-        }
-
-        // Set the new position in a single loop
-        for (int i = 0; i < NODE_NUM; i++)
-        {
-            if (board[i] == prevNode)
-            {
-                board[i]->occupied = false;
-            }
-            else if (board[i] == newNode)
-            {
-                board[i]->occupied = true;
-                board[i]->color = prevNode->color;
-            }
-        }
-
-        char *newWhitePos = (char *)malloc(NODE_NUM + 1);
-        char *newBlackPos = (char *)malloc(NODE_NUM + 1);
-        int whiteIndex = 0, blackIndex = 0;
-        for (int i = 0; i < NODE_NUM; i++)
-        {
-            if (board[i]->occupied)
-            {
-                if (board[i]->color == 0) // White
-                {
-                    newWhitePos[whiteIndex++] = board[i]->label;
-                }
-                else // Black
-                {
-                    newBlackPos[blackIndex++] = board[i]->label;
-                }
-            }
-        }
-        newWhitePos[whiteIndex] = '\0';
-        newBlackPos[blackIndex] = '\0';
-
-        unsigned long newHash = hashBoardState(board, NODE_NUM);
-        // printf("New Hash: %lu\n", newHash);
-        // Check if the new state is already in the hash table
-        if (lookupBoardState(newHash, newWhitePos, newBlackPos))
-        {
-#ifndef SIMPLE
-            printf("[Skipping]: State already visited.\n");
-#endif // !SIMPLE
-            free(newWhitePos);
-            free(newBlackPos);
-            continue; // Skip to the next iteration
-        }
-
-        // Insert the new state into the hash table
-        insertBoardState(newHash, newWhitePos, newBlackPos);
-        iteration++;
-
-        // Generate next states
-        predecessors[iteration].predecessor = state.predecessor;
-        strncpy(predecessors[iteration].move, state.move, 2);
-        predecessors[iteration].move[2] = '\0'; // Ensure null-termination
-
-        if (isGoalState(board, argv[3], argv[4]))
-        {
-            printf("Goal state reached!\n");
-            goalState = iteration;
-            printBoard(board);
-            int *path = (int *)malloc(QUEUE_SIZE * sizeof(int));
-            int pathLength = 0;
-            reconstructPath(predecessors, iteration, path, &pathLength);
-#ifndef SIMPLE
-            printBoardForSolution(board, argv[1], argv[2], path, pathLength, predecessors);
-#endif // !SIMPLE
-
-            free(path);
-            free(newWhitePos);
-            free(newBlackPos);
-            break;
-        }
-
-        generateNextStates(board, &queue, iteration);
-        // printQueue(&queue);
-
-        free(whitePieces);
-        free(blackPieces);
-
-        whitePieces = strdup(newWhitePos);
-        blackPieces = strdup(newBlackPos);
-        free(newWhitePos);
-        free(newBlackPos);
-        // sleep(2); // Sleep for 0.5 seconds
-    }
+    int found = solvePuzzle(argv[1], argv[2], argv[3], argv[4], moves, QUEUE_SIZE, &pathLength, &stats);
     end = clock();
     cpu_time_used = ((double)(end - start)) / CLOCKS_PER_SEC;
 
-    if (goalState == -1)
+    if (found < 0)
+    {
+        free(moves);
+        freeBoard(board);
+        return 1;
+    }
+    if (!found)
     {
         printf("No solution found.\n");
     }
     else
     {
+        printf("Goal state reached!\n");
+        setBoardState(board, argv[3], argv[4]);
+        printBoard(board);
+        printf("Reconstructed Path:\n");
+        for (int i = 0; i < pathLength; i++)
+        {
+            printf("%s\n", moves[i]);
+        }
 #ifndef SIMPLE
-        printf("Solution found in %d iterations.\n", goalState);
+        printBoardForSolution(board, argv[1], argv[2], moves, pathLength);
+        printf("Solution found in %d iterations.\n", stats.statesExpanded);
 #endif // !SIMPLE
     }
     printf("Time taken: %f seconds\n", cpu_time_used);
 
-    freeQueue(&queue);
-    free(whitePieces);
-    free(blackPieces);
-    for (int i = 0; i < NODE_NUM; i++)
+    free(moves);
+    freeBoard(board);
+    if (showStats)
     {
-        free(board[i]);
+        printStats(stderr, &stats, validateMs);
     }
 
-    freeHashTable();
-
     return 0;
 }
+#endif // NO_MAIN
@@ -0,0 +1,38 @@
+#ifndef PROG_H
+#define PROG_H
+
+#include <stdbool.h>
+
+// The linked-node solver in prog.c, for programs built with -DNO_MAIN that
+// link it in (such as bench.c).
+
+#define MAX_STATS_DEPTH 256
+
+// What one solvePuzzle call did, for --stats
+typedef struct SolverStats
+{
+    int statesExpanded;
+    int statesGenerated;
+    int duplicatesRejected;
+    unsigned long chainProbes; // Hash entries compared by lookupBoardState
+    int longestChain;          // Most entries compared in one lookup
+    int peakQueueSize;
+    int frontierSizes[MAX_STATS_DEPTH]; // States first reached at each depth
+    int depthCount;
+    double initMs; // Monotonic clock, per phase
+    double searchMs;
+    double reconstructMs;
+    double teardownMs;
+} SolverStats;
+
+// Searches breadth-first from the start to the goal positions, given as
+// strings of cell letters. The goal strings must list their cells in
+// alphabetical order. On success, moves holds the path as "XY" strings
+// (from X to Y), starting with the "--" entry of the start state, and
+// pathLength counts those entries (1 when the start is the goal). Returns 1
+// when a path was found, 0 when there is none and -1 after printing why
+// when memory runs out or the path does not fit in moves.
+int solvePuzzle(const char *whiteStart, const char *blackStart, const char *whiteGoal, const char *blackGoal,
+                char moves[][3], int maxMoves, int *pathLength, SolverStats *stats);
+
+#endif // PROG_H
@@ -1,63 +1,29 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <limits.h>
 #include <string.h>
 #include <time.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <fcntl.h>
+
+#include "board.h"
+#include "solver.h"
 
 #define BINARY
 #define SIMPLE
 
-#define TABLE_SIZE 1048576 // 2^20
-#define NUM_POSITIONS 14
-
-#define SET_BIT(variable, bit) ((variable) |= (1UL << (bit)))
-#define CLEAR_BIT(variable, bit) ((variable) &= ~(1UL << (bit)))
-#define CHECK_BIT(variable, bit) (((variable) >> (bit)) & 1)
-
-static inline int pos_offset(char pos)
-{
-    return 2 * (NUM_POSITIONS - 1 - (pos - 'A'));
-}
-
-uint32_t init_board(const char *white_pieces, const char *black_pieces)
-{
-    uint32_t board = 0;
-    for (int i = 0; white_pieces[i] != '\0'; i++)
-    {
-        int offset = pos_offset(white_pieces[i]);
-        board |= (0b01 << offset); // Set the bit for white pieces
-    }
-    for (int i = 0; black_pieces[i] != '\0'; i++)
-    {
-        int offset = pos_offset(black_pieces[i]);
-        board |= (0b11 << offset); // Set the bit for black pieces
-    }
-    return board;
-}
-
-static inline void move_piece(uint32_t *board, char from, char to)
-{
-    int from_offset = pos_offset(from);
-    int to_offset = pos_offset(to);
-
-    uint32_t mask = 0b11;
-    uint32_t piece = (*board >> from_offset) & mask;
-
-    if (piece == 0)
-    {
-        fprintf(stderr, "Error: No piece at position %c\n", from);
-        return;
-    }
-    if (CHECK_BIT(*board, to_offset))
-    {
-        fprintf(stderr, "Error: Position %c is already occupied\n", to);
-        return;
-    }
-
-    *board = (*board & ~(mask << from_offset) & ~(mask << to_offset)) | (piece << to_offset); // Set the piece in the new position
-}
-
-char get_symbol(uint32_t board, int pos_index)
+char get_symbol(board_t board, int pos_index)
 {
     int offset = 2 * (NUM_POSITIONS - 1 - pos_index);
     uint32_t val = (board >> offset) & 0b11;
@@ -66,13 +32,13 @@ char get_symbol(uint32_t board, int pos_index)
     return (val & 0b10) ? 'x' : 'o'; // Black or White
 }
 
-void print_board(uint32_t board)
+void print_board(board_t board)
 {
 #ifdef BINARY
     printf("0b");
     for (int i = NUM_POSITIONS * 2 - 1; i >= 0; i--)
     {
-        printf("%d", (board >> i) & 1);
+        printf("%d", (int)(board >> i) & 1);
     }
     printf("\n");
 #endif // BINARY
@@ -116,440 +82,1454 @@ void print_board(uint32_t board)
 #endif // !BINARY
 }
 
-#pragma region Queue Implementation
-typedef struct QueueNode
+#pragma region Output
+void print_path(board_t board, const int *moves, int move_count)
+{
+    printf("\nPath:\n\n");
+    for (int i = 0; i < move_count; i++)
+    {
+        char from = cell_name(move_from(moves[i]));
+        char to = cell_name(move_to(moves[i]));
+#ifdef SIMPLE
+        printf("%c%c\n", from, to);
+#else
+        move_piece(&board, from, to);
+        print_board(board);
+        printf("Move: %c -> %c | %x\n", from, to, moves[i]);
+#endif // !SIMPLE
+    }
+    printf("\n");
+}
+
+static void print_move_line(const int *moves, int move_count, void *arg)
+{
+    (void)arg;
+    for (int i = 0; i < move_count; i++)
+        printf("%s%c%c", i ? " " : "", cell_name(move_from(moves[i])), cell_name(move_to(moves[i])));
+    printf("\n");
+}
+
+static void print_indexed_path(const int *moves, int move_count, void *board_start)
+{
+    print_path(*(const board_t *)board_start, moves, move_count);
+}
+
+// Answers a path query for one puzzle. Returns 0 on allocation failure.
+static int run_path_query(Solver *solver, PathQuery query, uint64_t index, board_t board_start, board_t board_goal)
 {
-    uint32_t board;
-    int predecessor;
-    int move;
-    struct QueueNode *next;
-} QueueNode;
+    uint64_t total;
+    int length;
+    PathVisitor visit = query == PATHS_ALL ? print_move_line : print_indexed_path;
+    int found = solve_paths(solver, query, index, board_start, board_goal, visit, &board_start, &total, &length);
+    if (found == 0)
+        printf("No solution found.\n");
+    if (found <= 0)
+        return found == 0;
 
-typedef struct Queue
+    if (query == PATHS_COUNT)
+    {
+        printf("Shortest paths: %s%llu of %d moves\n", total == UINT64_MAX ? "at least " : "",
+               (unsigned long long)total, length);
+    }
+    else if (query == PATHS_INDEX && total == UINT64_MAX)
+    {
+        printf("Error: Too many shortest paths to index.\n");
+    }
+    else if (query == PATHS_INDEX && index >= total)
+    {
+        printf("Error: There are only %llu shortest paths.\n", (unsigned long long)total);
+    }
+    return 1;
+}
+#pragma endregion
+
+#pragma region Search Statistics
+typedef enum Phase
 {
-    QueueNode *head;
-    QueueNode *tail;
-    int size;
-} Queue;
+    PHASE_VALIDATE,
+    PHASE_INIT,
+    PHASE_SEARCH,
+    PHASE_RECONSTRUCT,
+    PHASE_TEARDOWN,
+    PHASE_COUNT
+} Phase;
 
-void init_queue(Queue *queue)
+// Gets a line of stats per answered request, unless NULL
+static FILE *stats_out = NULL;
+
+static double monotonic_ms()
 {
-    queue->head = NULL;
-    queue->tail = NULL;
-    queue->size = 0;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
 }
 
-static inline int is_queue_empty(Queue *queue)
+// Writes stats and the given phase timings as one line of JSON
+static void print_stats(FILE *out, const SearchStats *stats, const double phase_ms[PHASE_COUNT])
 {
-    return queue->head == NULL;
+    static const char *phase_names[PHASE_COUNT] = {"validate", "init", "search", "reconstruct", "teardown"};
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    fprintf(out, "{\"expanded\": %lu, \"generated\": %lu, \"duplicates\": %lu, \"probes\": %lu, \"peak_queue\": %lu, "
+                 "\"cycles_per_expanded\": %.1f, \"runs\": %lu, \"disk_bytes\": %lu, \"frontier\": [",
+            stats->expanded, stats->generated, stats->duplicates, stats->probes, stats->peak_queue,
+            stats->expanded ? (double)stats->cycles / stats->expanded : 0.0, stats->runs, stats->disk_bytes);
+    for (int d = 0; d < stats->depth_count; d++)
+        fprintf(out, d ? ", %lu" : "%lu", stats->frontier[d]);
+    fprintf(out, "], \"phases_ms\": {");
+    for (int p = 0; p < PHASE_COUNT; p++)
+        fprintf(out, "%s\"%s\": %.3f", p ? ", " : "", phase_names[p], phase_ms[p]);
+    fprintf(out, "}, \"peak_rss_kb\": %ld}\n", usage.ru_maxrss);
 }
+#pragma endregion
 
-static inline void enqueue(Queue *queue, uint32_t board, int move, int predecessor)
+#pragma region Solver Setup
+// What the options ask of a solver, so that parallel batch workers can each
+// open one like the main thread's
+typedef struct SolverConfig
 {
-    QueueNode *new_node = (QueueNode *)malloc(sizeof(QueueNode));
-    if (new_node == NULL)
+    Engine engine;
+    int threads;
+    int symmetry;
+    size_t goal_cache; // Bytes
+    size_t external_memory; // Bytes
+    const char *scratch_dir;
+    const char *topology_path;
+    const char *pdb_paths[2];
+    int pdb_count;
+    const char *tablebase_paths[MAX_TABLEBASES];
+    int tablebase_count;
+} SolverConfig;
+
+// Returns NULL after printing why when the solver or a table cannot be set up
+static Solver *open_solver(const SolverConfig *config)
+{
+    Solver *solver = solver_create(config->engine, config->threads);
+    if (solver == NULL)
+        return NULL;
+    if (config->topology_path != NULL && !solver_load_topology(solver, config->topology_path))
     {
-        perror("Failed to allocate memory for queue node");
-        return;
+        solver_destroy(solver);
+        return NULL;
+    }
+    solver_set_symmetry(solver, config->symmetry);
+    solver_set_goal_cache(solver, config->goal_cache);
+    if (!solver_set_external(solver, config->external_memory, config->scratch_dir))
+    {
+        solver_destroy(solver);
+        return NULL;
+    }
+    for (int i = 0; i < config->pdb_count; i++)
+    {
+        if (!solver_load_pattern_db(solver, config->pdb_paths[i]))
+        {
+            solver_destroy(solver);
+            return NULL;
+        }
+    }
+    for (int i = 0; i < config->tablebase_count; i++)
+    {
+        if (!solver_load_tablebase(solver, config->tablebase_paths[i]))
+        {
+            solver_destroy(solver);
+            return NULL;
+        }
     }
-    new_node->board = board;
-    new_node->move = move;
-    new_node->predecessor = predecessor;
-    new_node->next = NULL;
+    return solver;
+}
+#pragma endregion
 
-    if (is_queue_empty(queue))
+#pragma region Requests
+// Parses a packed board given in hex (with 0x), octal (with 0) or decimal,
+// as printed with BINARY off in print_board's %x form. Boards can be wider
+// than any strtoul result, so the digits are read here. Returns 0 when bits
+// outside the board's pairs are set or a pair holds the unused 10 pattern.
+static int parse_packed_board(const char *text, board_t *board, int *whites, int *blacks)
+{
+    int base = 10;
+    if (text[0] == '0' && (text[1] == 'x' || text[1] == 'X'))
     {
-        queue->head = new_node;
-        queue->tail = new_node;
+        base = 16;
+        text += 2;
     }
-    else
+    else if (text[0] == '0')
+    {
+        base = 8;
+    }
+    if (*text == '\0')
+        return 0;
+    board_t value = 0;
+    for (; *text != '\0'; text++)
     {
-        queue->tail->next = new_node;
-        queue->tail = new_node;
+        const char *digits = "0123456789abcdef";
+        const char *digit = strchr(digits, *text >= 'A' && *text <= 'F' ? *text - 'A' + 'a' : *text);
+        if (digit == NULL || digit - digits >= base || value > (BOARD_MASK - (digit - digits)) / base)
+            return 0;
+        value = value * base + (digit - digits);
     }
-    queue->size++;
+    *board = value;
+    return count_pieces(*board, whites, blacks);
 }
 
-static inline QueueNode *dequeue(Queue *queue)
+// Request fields hold a colour's cells or a packed board, in decimal at most
+// 39 digits on 64 cells; the built-in board keeps its old field width. They
+// are scanned one character wider, so that a longer field is rejected
+// instead of being split into the next one.
+#if BOARD_CELLS <= 15
+#define REQUEST_FIELD_MAX 15
+#define REQUEST_FIELD "%16s"
+#else
+#define REQUEST_FIELD_MAX 65
+#define REQUEST_FIELD "%66s"
+#endif
+#define REQUEST_FIELD_SIZE (REQUEST_FIELD_MAX + 2)
+
+// Reads one request line: "white black white-end black-end" ("-" for a
+// colour with no pieces) or "start goal" as packed boards. Returns 1 with
+// the boards set, 0 for blank and comment lines, and -1 with the reason in
+// error for malformed requests.
+static int parse_request(const char *line, board_t *board_start, board_t *board_goal, char *error,
+                         size_t error_size)
 {
-    if (is_queue_empty(queue))
+    char fields[4][REQUEST_FIELD_SIZE];
+    int count = sscanf(line, REQUEST_FIELD " " REQUEST_FIELD " " REQUEST_FIELD " " REQUEST_FIELD, fields[0], fields[1],
+                       fields[2], fields[3]);
+    if (count <= 0 || fields[0][0] == '#')
+        return 0; // Blank line or comment
+    for (int i = 0; i < count; i++)
     {
-        return NULL;
+        if (strlen(fields[i]) > REQUEST_FIELD_MAX)
+        {
+            snprintf(error, error_size, "Request field too long");
+            return -1;
+        }
+    }
+    if (count == 2)
+    {
+        int whites, blacks, goal_whites, goal_blacks;
+        if (!parse_packed_board(fields[0], board_start, &whites, &blacks) ||
+            !parse_packed_board(fields[1], board_goal, &goal_whites, &goal_blacks))
+        {
+            snprintf(error, error_size, "Invalid packed board");
+            return -1;
+        }
+        if (whites != goal_whites || blacks != goal_blacks)
+        {
+            snprintf(error, error_size, "Starting and ending positions must have the same number of pieces");
+            return -1;
+        }
     }
-    QueueNode *temp = queue->head;
-    queue->head = queue->head->next;
-    if (is_queue_empty(queue))
+    else if (count == 4)
     {
-        queue->tail = NULL; // Reset tail if the queue is empty
+        const char *pieces[4];
+        for (int i = 0; i < 4; i++)
+            pieces[i] = strcmp(fields[i], "-") == 0 ? "" : fields[i];
+        if (!validate_puzzle(pieces, error, error_size))
+            return -1;
+        *board_start = init_board(pieces[0], pieces[1]);
+        *board_goal = init_board(pieces[2], pieces[3]);
     }
-    queue->size--;
-    return temp;
+    else
+    {
+        snprintf(error, error_size, "Expected <white pieces> <black pieces> <white end> <black end>");
+        return -1;
+    }
+    return 1;
 }
 
-void free_queue(Queue *queue)
+#define REQUEST_LINE_MAX 256
+#define LINE_TOO_LONG "Request line too long"
+
+// Reads one request line into line, which holds REQUEST_LINE_MAX bytes.
+// Returns 1 for a line, 0 at the end of input and -1 for a line too long to
+// hold, which is skipped up to its end.
+static int read_request_line(FILE *input, char *line)
 {
-    QueueNode *current = queue->head;
-    while (current != NULL)
+    if (fgets(line, REQUEST_LINE_MAX, input) == NULL)
+        return 0;
+    size_t length = strlen(line);
+    if (length < REQUEST_LINE_MAX - 1 || line[length - 1] == '\n')
+        return 1;
+    int c = getc(input);
+    if (c == EOF || c == '\n')
+        return 1; // The line just fits
+    while (c != EOF && c != '\n')
+        c = getc(input);
+    return -1;
+}
+
+// Answers one request line (see parse_request) on out: the move count and
+// the moves, -1 when there is no solution, or an error message. A NULL line
+// stands for one too long to read. Returns 0 for blank and comment lines,
+// which get no answer, and -1 on allocation failure.
+static int answer_request(Solver *solver, const char *line, FILE *out)
+{
+    char error[128];
+    board_t board_start, board_goal;
+    double phase_ms[PHASE_COUNT] = {0};
+    double phase_start = monotonic_ms();
+    if (line == NULL)
+    {
+        fprintf(out, "error: %s\n", LINE_TOO_LONG);
+        return 1;
+    }
+    int parsed = parse_request(line, &board_start, &board_goal, error, sizeof(error));
+    if (parsed <= 0)
     {
-        QueueNode *temp = current;
-        current = current->next;
-        free(temp);
+        if (parsed < 0)
+            fprintf(out, "error: %s\n", error);
+        return parsed < 0;
     }
-    queue->head = NULL;
-    queue->tail = NULL;
-    queue->size = 0;
+
+    const int *moves;
+    int move_count;
+    double search_start = monotonic_ms();
+    phase_ms[PHASE_VALIDATE] = search_start - phase_start;
+    int found = solve(solver, board_start, board_goal, &moves, &move_count);
+    if (stats_out != NULL)
+    {
+        const SearchStats *stats = solver_stats(solver);
+        phase_ms[PHASE_INIT] = stats->init_ms;
+        phase_ms[PHASE_SEARCH] = monotonic_ms() - search_start - stats->init_ms - stats->reconstruct_ms;
+        phase_ms[PHASE_RECONSTRUCT] = stats->reconstruct_ms;
+        flockfile(stats_out); // Parallel batch workers share it
+        print_stats(stats_out, stats, phase_ms);
+        funlockfile(stats_out);
+    }
+    if (found < 0)
+        return -1;
+    if (found == 0)
+    {
+        fprintf(out, "-1\n");
+    }
+    else
+    {
+        fprintf(out, "%d", move_count);
+        for (int i = 0; i < move_count; i++)
+            fprintf(out, " %c%c", cell_name(move_from(moves[i])), cell_name(move_to(moves[i])));
+        fprintf(out, "\n");
+    }
+    return 1;
 }
 
-void print_queue(Queue *queue)
+// Answers every puzzle in input on stdout, one line each (see answer_request)
+static int run_batch(Solver *solver, FILE *input)
 {
-    printf("Queue: ");
-    QueueNode *current = queue->head;
-    while (current != NULL)
+    char line[REQUEST_LINE_MAX];
+    int solved = 0, status;
+    while ((status = read_request_line(input, line)) != 0)
     {
-        printf("%x ", current->board);
-        current = current->next;
+        int answered = answer_request(solver, status > 0 ? line : NULL, stdout);
+        if (answered < 0)
+            return 0;
+        solved += answered;
     }
-    printf("\n");
+    fprintf(stderr, "Answered %d puzzles\n", solved);
+    return 1;
 }
 #pragma endregion
-#pragma region Hash Table Implementation
-typedef struct HashEntry
+
+#pragma region Parallel Batch
+// With --jobs, a batch is answered by several workers, each with its own
+// solver. The input is read whole and its lines are dealt round-robin to one
+// deque per worker, hardest first: by the size of the state space, then by
+// the solver's lower bound, so deep instances start early instead of holding
+// up the end of the batch. A worker takes lines from the front of its own
+// deque and, once that is empty, steals from the back of the others. Answers
+// go into a reorder buffer, from which the main thread writes each one as
+// soon as every earlier line is answered, so the output is in input order.
+typedef struct BatchDeque
+{
+    int *lines; // Indices into BatchJob.lines
+    int head;
+    int tail;
+    pthread_mutex_t lock;
+} BatchDeque;
+
+typedef struct BatchJob
+{
+    const SolverConfig *config;
+    char **lines;
+    int line_count;
+    BatchDeque *deques;
+    int worker_count;
+    char **replies; // Reorder buffer: each line's answer, NULL until it is written
+    size_t *reply_lengths;
+    int answered;
+    int failed;
+    pthread_mutex_t lock; // Guards the reorder buffer, answered and failed
+    pthread_cond_t ready;
+} BatchJob;
+
+typedef struct BatchWorker
 {
-    uint32_t board;
-    struct HashEntry *next;
-} HashEntry;
+    BatchJob *job;
+    int id;
+} BatchWorker;
 
-HashEntry *hash_table[TABLE_SIZE];
+typedef struct BatchOrder
+{
+    uint64_t difficulty;
+    int line;
+} BatchOrder;
 
-static inline unsigned long hash_board_state(uint32_t board)
+static int compare_batch_order(const void *a, const void *b)
 {
-    return board % TABLE_SIZE;
+    const BatchOrder *x = (const BatchOrder *)a, *y = (const BatchOrder *)b;
+    if (x->difficulty != y->difficulty)
+        return x->difficulty < y->difficulty ? 1 : -1;
+    return x->line - y->line;
 }
 
-void init_hash_table()
+// Returns the next line for worker id, or -1 once every deque is empty.
+// Deques only shrink after they are dealt, so an empty one stays empty.
+static int take_batch_line(BatchJob *job, int id)
 {
-    for (int i = 0; i < TABLE_SIZE; i++)
+    for (int i = 0; i < job->worker_count; i++)
     {
-        hash_table[i] = NULL;
+        BatchDeque *deque = &job->deques[(id + i) % job->worker_count];
+        int line = -1;
+        pthread_mutex_lock(&deque->lock);
+        if (deque->head < deque->tail)
+            line = i == 0 ? deque->lines[deque->head++] : deque->lines[--deque->tail];
+        pthread_mutex_unlock(&deque->lock);
+        if (line >= 0)
+            return line;
     }
+    return -1;
 }
 
-static void insert_board_state(uint32_t board)
+static void *batch_worker(void *arg)
 {
-    unsigned long key = hash_board_state(board);
-    HashEntry *new_entry = (HashEntry *)malloc(sizeof(HashEntry));
-    if (new_entry == NULL)
+    BatchWorker *worker = (BatchWorker *)arg;
+    BatchJob *job = worker->job;
+    Solver *solver = open_solver(job->config);
+    int line;
+    while (solver != NULL && !__atomic_load_n(&job->failed, __ATOMIC_RELAXED) &&
+           (line = take_batch_line(job, worker->id)) >= 0)
     {
-        perror("Failed to allocate memory for hash entry");
-        return;
+        char *reply = NULL;
+        size_t reply_length = 0;
+        FILE *out = open_memstream(&reply, &reply_length);
+        int answered = out == NULL ? -1 : answer_request(solver, job->lines[line], out);
+        if (out != NULL)
+            fclose(out);
+
+        pthread_mutex_lock(&job->lock);
+        if (answered < 0 || reply == NULL)
+        {
+            __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+            free(reply);
+        }
+        else
+        {
+            job->replies[line] = reply;
+            job->reply_lengths[line] = reply_length;
+            job->answered += answered;
+        }
+        pthread_cond_signal(&job->ready);
+        pthread_mutex_unlock(&job->lock);
+    }
+    if (solver == NULL)
+    {
+        pthread_mutex_lock(&job->lock);
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+        pthread_cond_signal(&job->ready);
+        pthread_mutex_unlock(&job->lock);
     }
-    new_entry->board = board;
-    new_entry->next = hash_table[key];
-    hash_table[key] = new_entry;
+    solver_destroy(solver);
+    return NULL;
 }
 
-static int lookup_board_state(uint32_t board)
+// Reads input whole into lines, with NULL for lines too long to read (see
+// answer_request). Returns the line count, or -1 when memory runs out.
+static int read_batch_lines(FILE *input, char ***lines)
 {
-    unsigned long key = hash_board_state(board);
-    HashEntry *current = hash_table[key];
-    while (current != NULL)
+    char line[REQUEST_LINE_MAX];
+    int count = 0, capacity = 0, status;
+    *lines = NULL;
+    while ((status = read_request_line(input, line)) != 0)
     {
-        if (current->board == board)
+        if (count == capacity)
         {
-            return 1; // Found
+            capacity = capacity ? 2 * capacity : 1024;
+            char **grown = (char **)realloc(*lines, capacity * sizeof(char *));
+            if (grown == NULL)
+                break;
+            *lines = grown;
         }
-        current = current->next;
+        if (((*lines)[count] = status > 0 ? strdup(line) : NULL) == NULL && status > 0)
+            break;
+        count++;
+    }
+    if (!feof(input))
+    {
+        perror("Failed to allocate memory for batch");
+        for (int i = 0; i < count; i++)
+            free((*lines)[i]);
+        free(*lines);
+        return -1;
     }
-    return 0; // Not found
+    return count;
 }
 
-void free_hash_table()
+// Answers every puzzle in input on stdout with worker_count workers, in the
+// same order and format as run_batch
+static int run_parallel_batch(Solver *solver, const SolverConfig *config, int worker_count, FILE *input)
 {
-    for (int i = 0; i < TABLE_SIZE; i++)
+    BatchJob job;
+    memset(&job, 0, sizeof(job));
+    job.config = config;
+    job.worker_count = worker_count;
+    job.line_count = read_batch_lines(input, &job.lines);
+    if (job.line_count < 0)
+        return 0;
+
+    BatchOrder *order = (BatchOrder *)malloc((job.line_count + 1) * sizeof(BatchOrder));
+    int *dealt = (int *)malloc((job.line_count + 1) * sizeof(int));
+    job.replies = (char **)calloc(job.line_count + 1, sizeof(char *));
+    job.reply_lengths = (size_t *)calloc(job.line_count + 1, sizeof(size_t));
+    job.deques = (BatchDeque *)calloc(worker_count, sizeof(BatchDeque));
+    pthread_t *threads = (pthread_t *)malloc(worker_count * sizeof(pthread_t));
+    BatchWorker *workers = (BatchWorker *)malloc(worker_count * sizeof(BatchWorker));
+    int ok = order != NULL && dealt != NULL && job.replies != NULL && job.reply_lengths != NULL &&
+             job.deques != NULL && threads != NULL && workers != NULL;
+    if (!ok)
+        perror("Failed to allocate memory for batch");
+
+    // Lines that are not puzzles, or that the oracle rules out, are cheap
+    init_binomials();
+    for (int i = 0; ok && i < job.line_count; i++)
+    {
+        board_t board_start, board_goal;
+        char error[128];
+        int whites, blacks, bound;
+        order[i].line = i;
+        order[i].difficulty = 0;
+        if (job.lines[i] != NULL &&
+            parse_request(job.lines[i], &board_start, &board_goal, error, sizeof(error)) == 1 &&
+            (bound = solver_lower_bound(solver, board_start, board_goal)) >= 0 &&
+            count_pieces(board_start, &whites, &blacks))
+            order[i].difficulty = ((uint64_t)count_states(whites, blacks) << 16) | (bound + 1);
+    }
+    int deques_ready = ok;
+    if (ok)
+    {
+        qsort(order, job.line_count, sizeof(BatchOrder), compare_batch_order);
+        // Worker w gets the w-th, (w + n)-th, ... hardest lines, in that order
+        int offset = 0;
+        for (int w = 0; w < worker_count; w++)
+        {
+            BatchDeque *deque = &job.deques[w];
+            deque->lines = dealt + offset;
+            for (int i = w; i < job.line_count; i += worker_count)
+                deque->lines[deque->tail++] = order[i].line;
+            offset += deque->tail;
+            pthread_mutex_init(&deque->lock, NULL);
+        }
+    }
+    free(order);
+
+    int started = 0;
+    if (ok)
     {
-        HashEntry *current = hash_table[i];
-        while (current != NULL)
+        pthread_mutex_init(&job.lock, NULL);
+        pthread_cond_init(&job.ready, NULL);
+        for (; started < worker_count; started++)
+        {
+            workers[started].job = &job;
+            workers[started].id = started;
+            if (pthread_create(&threads[started], NULL, batch_worker, &workers[started]) != 0)
+                break; // The workers that did start steal the rest
+        }
+        if (started == 0)
         {
-            HashEntry *temp = current;
-            current = current->next;
-            free(temp);
+            fprintf(stderr, "Error: Failed to start batch workers.\n");
+            ok = 0;
         }
-        hash_table[i] = NULL;
     }
+
+    // Write each answer once every earlier one is out
+    if (ok)
+    {
+        pthread_mutex_lock(&job.lock);
+        for (int next = 0; next < job.line_count; next++)
+        {
+            while (job.replies[next] == NULL && !job.failed)
+                pthread_cond_wait(&job.ready, &job.lock);
+            if (job.failed)
+                break;
+            char *reply = job.replies[next];
+            job.replies[next] = NULL;
+            pthread_mutex_unlock(&job.lock);
+            fwrite(reply, 1, job.reply_lengths[next], stdout);
+            free(reply);
+            pthread_mutex_lock(&job.lock);
+        }
+        ok = !job.failed;
+        pthread_mutex_unlock(&job.lock);
+    }
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+    if (started > 0)
+    {
+        pthread_cond_destroy(&job.ready);
+        pthread_mutex_destroy(&job.lock);
+    }
+    if (ok)
+        fprintf(stderr, "Answered %d puzzles\n", job.answered);
+
+    for (int w = 0; deques_ready && w < worker_count; w++)
+        pthread_mutex_destroy(&job.deques[w].lock);
+    for (int i = 0; i < job.line_count; i++)
+    {
+        free(job.lines[i]);
+        if (job.replies != NULL)
+            free(job.replies[i]);
+    }
+    free(job.lines);
+    free(job.replies);
+    free(job.reply_lengths);
+    free(job.deques);
+    free(dealt);
+    free(threads);
+    free(workers);
+    return ok;
 }
 #pragma endregion
-#pragma region Predecessor Table Implementation
-typedef struct Predecessor
+
+#pragma region Server
+// A daemon that answers the batch line protocol over a Unix socket, so the
+// tables, pattern databases and tablebases stay loaded between requests.
+// One epoll loop serves every connection: input is split into lines, and
+// replies are queued per connection and flushed as the socket accepts them.
+// The loop never solves anything itself: each connection hands one line at a
+// time to a pool of workers, each with its own solver, and passes on the
+// next only once that reply is back. Replies stay in request order, and a
+// slow puzzle holds up its own connection but not the others. A worker posts
+// the finished reply and writes a byte to a pipe the loop also waits on.
+#define SERVER_LINE_MAX 256
+#define SERVER_MAX_EVENTS 64
+
+typedef struct Connection
+{
+    int fd; // -1 once closed while a worker still holds the connection
+    char input[SERVER_LINE_MAX];
+    size_t input_length;
+    int discarding; // Dropping the rest of an overlong line
+    char *output;
+    size_t output_length;
+    size_t output_capacity;
+    size_t output_sent;
+    int closing; // The client is done sending; close once replies are out
+    int busy;    // A worker is answering request
+    char request[SERVER_LINE_MAX];
+    char *reply; // Set by the worker, with answered as answer_request returned
+    size_t reply_length;
+    int answered;
+    struct Connection *next; // In the pool's queue or done list
+} Connection;
+
+typedef struct ServerPool ServerPool;
+
+typedef struct ServerWorker
+{
+    ServerPool *pool;
+    Solver *solver;
+    pthread_t thread;
+} ServerWorker;
+
+struct ServerPool
+{
+    ServerWorker *workers;
+    int worker_count;
+    Connection *queue_head; // Requests waiting for a worker, oldest first
+    Connection *queue_tail;
+    Connection *done; // Answered requests waiting for the loop
+    int stopping;
+    pthread_mutex_t lock; // Guards the queue, the done list and stopping
+    pthread_cond_t work;
+    int wake[2]; // Pipe a worker writes to once a reply is done
+};
+
+static volatile sig_atomic_t server_stopping = 0;
+
+static void stop_server(int signal_number)
 {
-    uint32_t board;
-    int predecessor;
-    int move;
-} Predecessor;
+    (void)signal_number;
+    server_stopping = 1;
+}
 
-Predecessor predecessors[TABLE_SIZE];
+static int set_nonblocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
 
-static void init_predecessor_table()
+static int append_output(Connection *connection, const char *data, size_t length)
 {
-    for (int i = 0; i < TABLE_SIZE; i++)
+    if (connection->output_length + length > connection->output_capacity)
     {
-        predecessors[i].predecessor = -1;
-        predecessors[i].move = -1;
+        size_t capacity = connection->output_capacity ? connection->output_capacity : SERVER_LINE_MAX;
+        while (capacity < connection->output_length + length)
+            capacity *= 2;
+        char *output = (char *)realloc(connection->output, capacity);
+        if (output == NULL)
+            return 0;
+        connection->output = output;
+        connection->output_capacity = capacity;
     }
+    memcpy(connection->output + connection->output_length, data, length);
+    connection->output_length += length;
+    return 1;
 }
 
-static inline void set_predecessor(int index, int predecessor, int move, uint32_t board)
+// A connection a worker is answering for is only freed once its reply is
+// back (see collect_replies)
+static void close_connection(int epoll_fd, Connection *connection)
 {
-    predecessors[index].board = board;
-    predecessors[index].predecessor = predecessor;
-    predecessors[index].move = move;
+    if (connection->fd >= 0)
+    {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+        close(connection->fd);
+        connection->fd = -1;
+    }
+    if (connection->busy)
+        return;
+    free(connection->output);
+    free(connection);
 }
 
-void reconstruct_path(int goal_index, int path[], int *path_length)
+// Writes as much queued output as the socket takes and asks for EPOLLOUT
+// while some is left. Input is only read while there is room for it.
+// Returns 0 when the connection broke.
+static int flush_connection(int epoll_fd, Connection *connection)
 {
-    if (predecessors == NULL || path == NULL || path_length == NULL)
+    while (connection->output_sent < connection->output_length)
     {
-        fprintf(stderr, "[Error]: Null pointer passed to reconstructPath.\n");
-        return;
+        ssize_t sent = write(connection->fd, connection->output + connection->output_sent,
+                             connection->output_length - connection->output_sent);
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return 0;
+        connection->output_sent += sent;
+    }
+    if (connection->output_sent == connection->output_length)
+        connection->output_sent = connection->output_length = 0;
+
+    int reading = !connection->closing && connection->input_length < SERVER_LINE_MAX - 1;
+    struct epoll_event event;
+    event.events = (reading ? EPOLLIN : 0) | (connection->output_length > 0 ? EPOLLOUT : 0);
+    event.data.ptr = connection;
+    return epoll_ctl(epoll_fd, EPOLL_CTL_MOD, connection->fd, &event) == 0;
+}
+
+// Whether the connection is finished: the client is done sending and every
+// line it sent has been answered and written
+static int connection_done(const Connection *connection)
+{
+    return connection->closing && !connection->busy && connection->output_length == 0;
+}
+
+static void *server_worker(void *arg)
+{
+    ServerWorker *worker = (ServerWorker *)arg;
+    ServerPool *pool = worker->pool;
+    pthread_mutex_lock(&pool->lock);
+    for (;;)
+    {
+        while (pool->queue_head == NULL && !pool->stopping)
+            pthread_cond_wait(&pool->work, &pool->lock);
+        if (pool->stopping)
+            break;
+        Connection *connection = pool->queue_head;
+        pool->queue_head = connection->next;
+        if (pool->queue_head == NULL)
+            pool->queue_tail = NULL;
+        pthread_mutex_unlock(&pool->lock);
+
+        char *reply = NULL;
+        size_t reply_length = 0;
+        FILE *out = open_memstream(&reply, &reply_length);
+        int answered = out == NULL ? -1 : answer_request(worker->solver, connection->request, out);
+        if (out != NULL)
+            fclose(out);
+
+        pthread_mutex_lock(&pool->lock);
+        connection->reply = reply;
+        connection->reply_length = reply_length;
+        connection->answered = answered;
+        connection->next = pool->done;
+        pool->done = connection;
+        ssize_t woken = write(pool->wake[1], "", 1);
+        (void)woken; // A full pipe already holds a wakeup
     }
-    // Initialize path length
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
 
-    // Reconstruct the path from the goal index to the start
-    int current_index = goal_index;
-    int index = 0;
-    while (current_index != -1)
+// Hands the connection's next complete line to the workers unless one is
+// already being answered, which keeps replies in request order. A full
+// buffer with no line end is answered with an error and the rest of that
+// line dropped. Returns 0 when memory runs out.
+static int dispatch_line(ServerPool *pool, Connection *connection)
+{
+    if (connection->busy)
+        return 1;
+    char *newline = (char *)memchr(connection->input, '\n', connection->input_length);
+    if (newline == NULL)
     {
-        // printf("Current index: %d\n", current_index);
-        path[index] = current_index;
-        current_index = predecessors[current_index].predecessor;
-        index++;
+        if (connection->input_length < SERVER_LINE_MAX - 1)
+            return 1;
+        static const char message[] = "error: " LINE_TOO_LONG "\n";
+        connection->input_length = 0;
+        connection->discarding = 1;
+        return append_output(connection, message, sizeof(message) - 1);
     }
+    size_t length = newline - connection->input;
+    memcpy(connection->request, connection->input, length);
+    connection->request[length] = '\0';
+    connection->input_length -= length + 1;
+    memmove(connection->input, newline + 1, connection->input_length);
 
-    *path_length = index;
+    connection->busy = 1;
+    connection->next = NULL;
+    pthread_mutex_lock(&pool->lock);
+    if (pool->queue_tail != NULL)
+        pool->queue_tail->next = connection;
+    else
+        pool->queue_head = connection;
+    pool->queue_tail = connection;
+    pthread_cond_signal(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+    return 1;
+}
 
-    // Reverse the path to get it from start to goal
-    for (int i = 0; i < *path_length / 2; i++)
+// Reads what the client sent while there is room for it. Returns 0 once the
+// connection should close.
+static int read_connection(ServerPool *pool, Connection *connection, int *fatal)
+{
+    while (connection->input_length < SERVER_LINE_MAX - 1)
     {
-        int temp = path[i];
-        path[i] = path[*path_length - 1 - i];
-        path[*path_length - 1 - i] = temp;
+        ssize_t received = read(connection->fd, connection->input + connection->input_length,
+                                SERVER_LINE_MAX - 1 - connection->input_length);
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return 1;
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            return 0;
+
+        if (connection->discarding)
+        {
+            char *newline = memchr(connection->input, '\n', received);
+            if (newline == NULL)
+                continue;
+            connection->discarding = 0;
+            size_t rest = received - (newline + 1 - connection->input);
+            memmove(connection->input, newline + 1, rest);
+            received = rest;
+        }
+        connection->input_length += received;
+        if (!dispatch_line(pool, connection))
+        {
+            *fatal = 1;
+            return 0;
+        }
     }
+    return 1; // Full behind a line being answered; reading resumes after it
 }
 
-void print_path(int *path, int path_length)
+// Queues the replies the workers have finished, hands each connection its
+// next line and closes the connections that are done. Returns 0 on a fatal
+// error.
+static int collect_replies(ServerPool *pool, int epoll_fd)
 {
-    printf("\nPath:\n\n");
-    for (int i = 0; i < path_length; i++)
+    char drain[64];
+    while (read(pool->wake[0], drain, sizeof(drain)) > 0)
+        ;
+    pthread_mutex_lock(&pool->lock);
+    Connection *done = pool->done;
+    pool->done = NULL;
+    pthread_mutex_unlock(&pool->lock);
+
+    int ok = 1;
+    while (done != NULL)
     {
-        int move = predecessors[path[i]].move;
-        char from = 'A' + ((move >> 4) & 0b1111);
-        char to = 'A' + (move & 0b1111);
-#ifdef SIMPLE
-        printf("%c%c\n", from, to);
-#else
-        print_board(predecessors[path[i]].board);
-        printf("Move: %c -> %c | %x, Predecessor: %d\n",
-               from, to, predecessors[path[i]].move, predecessors[path[i]].predecessor);
-#endif // !SIMPLE
+        Connection *connection = done;
+        done = connection->next;
+        connection->busy = 0;
+        // A connection closed while busy only waited for its reply to be freed
+        ok = ok && connection->answered >= 0 && connection->reply != NULL &&
+             (connection->fd < 0 || append_output(connection, connection->reply, connection->reply_length));
+        free(connection->reply);
+        connection->reply = NULL;
+        if (ok && connection->fd >= 0 && !dispatch_line(pool, connection))
+            ok = 0;
+        if (!ok || connection->fd < 0 || !flush_connection(epoll_fd, connection) || connection_done(connection))
+            close_connection(epoll_fd, connection);
     }
-    printf("\n");
+    return ok;
 }
 
-#pragma endregion
+// Clears the way for binding path. Only a socket that refuses connections,
+// left behind by a daemon that died, is removed; any other file, or a
+// socket something still listens on, is an error.
+static int remove_stale_socket(const char *path, const struct sockaddr_un *address)
+{
+    struct stat status;
+    if (lstat(path, &status) != 0)
+    {
+        if (errno == ENOENT)
+            return 1;
+        perror(path);
+        return 0;
+    }
+    if (!S_ISSOCK(status.st_mode))
+    {
+        fprintf(stderr, "Error: %s exists and is not a socket.\n", path);
+        return 0;
+    }
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe < 0)
+    {
+        perror("socket");
+        return 0;
+    }
+    int refused = connect(probe, (const struct sockaddr *)address, sizeof(*address)) != 0 && errno == ECONNREFUSED;
+    close(probe);
+    if (!refused)
+    {
+        fprintf(stderr, "Error: %s is in use by another daemon.\n", path);
+        return 0;
+    }
+    if (unlink(path) != 0)
+    {
+        perror(path);
+        return 0;
+    }
+    return 1;
+}
 
-static inline void generateNextState(Queue *queue, uint32_t board, const int neighbors[NUM_POSITIONS][4], int predecessor)
+// Removes path only while it is still the socket this process bound
+static void remove_own_socket(const char *path, const struct stat *bound)
 {
-    for (int i = 0; i < NUM_POSITIONS; i++)
+    struct stat status;
+    if (lstat(path, &status) == 0 && status.st_dev == bound->st_dev && status.st_ino == bound->st_ino)
+        unlink(path);
+}
+
+// Starts worker_count workers, the first on the main thread's solver and the
+// others on solvers opened the same way. Returns 0 after printing why when
+// one cannot start; stop_server_pool then stops those that did.
+static int start_server_pool(ServerPool *pool, Solver *solver, const SolverConfig *config, int worker_count)
+{
+    memset(pool, 0, sizeof(*pool));
+    pool->wake[0] = pool->wake[1] = -1;
+    pool->workers = (ServerWorker *)calloc(worker_count, sizeof(ServerWorker));
+    if (pool->workers == NULL)
     {
-        char from = 'A' + i;
-        int state = (board >> pos_offset(from)) & 0b11;
-        if ((state & 0b01) == 0)
-            continue; // No piece at this position
+        perror("Failed to allocate memory for server workers");
+        return 0;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    if (pipe(pool->wake) != 0 || !set_nonblocking(pool->wake[0]) || !set_nonblocking(pool->wake[1]))
+    {
+        perror("pipe");
+        return 0;
+    }
 
-        for (int j = 0; j < 4; j++)
+    // SIGINT and SIGTERM must reach the loop's epoll_wait, not a worker
+    sigset_t signals, previous;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, &previous);
+    for (; pool->worker_count < worker_count; pool->worker_count++)
+    {
+        ServerWorker *worker = &pool->workers[pool->worker_count];
+        worker->pool = pool;
+        worker->solver = pool->worker_count == 0 ? solver : open_solver(config);
+        if (worker->solver == NULL)
+            break;
+        if (pthread_create(&worker->thread, NULL, server_worker, worker) != 0)
         {
-            int neighbor = neighbors[i][j];
-            if (neighbor == -1)
-                break; // No more neighbor
+            if (worker->solver != solver)
+                solver_destroy(worker->solver);
+            fprintf(stderr, "Error: Failed to start server workers.\n");
+            break;
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    return pool->worker_count == worker_count;
+}
+
+// Lets the workers finish the puzzles they are on and frees their solvers,
+// except the main thread's
+static void stop_server_pool(ServerPool *pool, Solver *solver)
+{
+    if (pool->workers == NULL)
+        return;
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->worker_count; i++)
+    {
+        pthread_join(pool->workers[i].thread, NULL);
+        if (pool->workers[i].solver != solver)
+            solver_destroy(pool->workers[i].solver);
+    }
+    pthread_cond_destroy(&pool->work);
+    pthread_mutex_destroy(&pool->lock);
+    for (int i = 0; i < 2; i++)
+        if (pool->wake[i] >= 0)
+            close(pool->wake[i]);
+    free(pool->workers);
+    pool->workers = NULL;
+}
+
+static int run_server(Solver *solver, const SolverConfig *config, int worker_count, const char *path)
+{
+    struct sockaddr_un address;
+    if (strlen(path) >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, "Error: Socket path is too long.\n");
+        return 0;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0)
+    {
+        perror("socket");
+        return 0;
+    }
+    if (!remove_stale_socket(path, &address))
+    {
+        close(listen_fd);
+        return 0;
+    }
+    struct stat bound;
+    if (bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+    {
+        perror(path);
+        close(listen_fd);
+        return 0;
+    }
+    if (lstat(path, &bound) != 0 || listen(listen_fd, SOMAXCONN) != 0 || !set_nonblocking(listen_fd))
+    {
+        perror(path);
+        close(listen_fd);
+        unlink(path);
+        return 0;
+    }
+    int epoll_fd = epoll_create1(0);
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = NULL; // The listening socket
+    if (epoll_fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event) != 0)
+    {
+        perror("epoll");
+        close(listen_fd);
+        remove_own_socket(path, &bound);
+        return 0;
+    }
+    ServerPool pool;
+    int pool_ok = start_server_pool(&pool, solver, config, worker_count);
+    event.data.ptr = &pool; // The workers' wakeup pipe
+    if (pool_ok && epoll_ctl(epoll_fd, EPOLL_CTL_ADD, pool.wake[0], &event) != 0)
+    {
+        perror("epoll");
+        pool_ok = 0;
+    }
+    if (!pool_ok)
+    {
+        stop_server_pool(&pool, solver);
+        close(epoll_fd);
+        close(listen_fd);
+        remove_own_socket(path, &bound);
+        return 0;
+    }
 
-            char to = 'A' + neighbor;
-            int to_state = (board >> pos_offset(to)) & 0b11;
-            if (to_state == 0) // Empty position
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop_server;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    fprintf(stderr, "Listening on %s with %d worker%s\n", path, worker_count, worker_count == 1 ? "" : "s");
+
+    int fatal = 0;
+    long served = 0;
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    while (!server_stopping && !fatal)
+    {
+        int ready = epoll_wait(epoll_fd, events, SERVER_MAX_EVENTS, -1);
+        if (ready < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait");
+            break;
+        }
+        int replies = 0;
+        for (int e = 0; e < ready && !fatal; e++)
+        {
+            Connection *connection = (Connection *)events[e].data.ptr;
+            if (events[e].data.ptr == &pool)
+            {
+                // Handled after the connections' events, since a reply can free a connection they refer to
+                replies = 1;
+                continue;
+            }
+            if (connection == NULL)
             {
-                uint32_t new_board = board;
-                move_piece(&new_board, from, to);
-                if (!lookup_board_state(new_board))
+                int fd;
+                while ((fd = accept(listen_fd, NULL, NULL)) >= 0)
                 {
-                    int move = ((from - 'A') << 4) | (to - 'A');
-                    // printf("Move: %c->%c | %x\n", from, to, move);
-                    enqueue(queue, new_board, move, predecessor);
-                    insert_board_state(new_board);
+                    connection = (Connection *)calloc(1, sizeof(Connection));
+                    event.events = EPOLLIN;
+                    event.data.ptr = connection;
+                    if (connection == NULL || !set_nonblocking(fd) ||
+                        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0)
+                    {
+                        free(connection);
+                        close(fd);
+                        continue;
+                    }
+                    connection->fd = fd;
+                    served++;
                 }
+                continue;
             }
+
+            if ((events[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && !connection->closing)
+                connection->closing = !read_connection(&pool, connection, &fatal);
+            // Replies still go out when the client has only finished sending,
+            // but not once it has hung up altogether
+            if (fatal || (events[e].events & (EPOLLHUP | EPOLLERR)) || !flush_connection(epoll_fd, connection) ||
+                connection_done(connection))
+                close_connection(epoll_fd, connection);
         }
+        if (replies && !fatal && !collect_replies(&pool, epoll_fd))
+            fatal = 1;
+    }
+
+    stop_server_pool(&pool, solver);
+    close(epoll_fd);
+    close(listen_fd);
+    remove_own_socket(path, &bound);
+    fprintf(stderr, "Served %ld connections\n", served);
+    return !fatal;
+}
+#pragma endregion
+
+#pragma region Options
+// Parses a whole non-negative decimal number. Returns 0 when text is not one
+// or does not fit.
+static int parse_count(const char *text, uint64_t *value)
+{
+    if (*text < '0' || *text > '9')
+        return 0; // strtoull would take a sign or leading spaces
+    char *end;
+    errno = 0;
+    unsigned long long parsed = strtoull(text, &end, 10);
+    if (errno != 0 || *end != '\0')
+        return 0;
+    *value = parsed;
+    return 1;
+}
+
+// Parses a non-negative number of megabytes, fractions allowed, into bytes
+static int parse_megabytes(const char *text, size_t *bytes)
+{
+    char *end;
+    errno = 0;
+    double megabytes = strtod(text, &end);
+    if (end == text || *end != '\0' || errno != 0 || !(megabytes >= 0) ||
+        megabytes * (1 << 20) >= (double)SIZE_MAX)
+        return 0;
+    *bytes = (size_t)(megabytes * (1 << 20));
+    return 1;
+}
+
+// Parses the count given to option, where 0 means one per online processor.
+// Returns 0 after printing why when text is not a count.
+static int parse_thread_count(const char *option, const char *text, int *count)
+{
+    uint64_t value;
+    if (!parse_count(text, &value) || value > INT_MAX)
+    {
+        fprintf(stderr, "Error: %s takes a count, or 0 for one per processor, not %s.\n", option, text);
+        return 0;
     }
+    *count = (int)value;
+    if (*count == 0)
+        *count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (*count <= 0)
+        *count = 1;
+    return 1;
 }
+#pragma endregion
 
 int main(int argc, char *argv[])
 {
     clock_t start, end;
     double cpu_time_used;
     start = clock();
+    double phase_ms[PHASE_COUNT] = {0};
+    double phase_start = monotonic_ms();
 
 #pragma region Argument Validation
-    if (argc != 5)
-    {
-        fprintf(stderr, "Usage: %s <white pieces> <black pieces> <white end> <black end>\n", argv[0]);
-        return 1;
-    }
-
-    if (strlen(argv[1]) != strlen(argv[3]) || strlen(argv[2]) != strlen(argv[4]))
+    // Options come before the positions; strip them so argv[1..4] are the pieces
+    SolverConfig config;
+    memset(&config, 0, sizeof(config));
+    config.engine = ENGINE_BFS;
+    config.threads = 1;
+    config.external_memory = EXTERNAL_DEFAULT_MEMORY;
+    int jobs = 1;
+    int jobs_given = 0;
+    int show_stats = 0;
+    PathQuery path_query = PATHS_NONE;
+    uint64_t path_index = 0;
+    int batch = 0;
+    const char *batch_path = NULL;
+    const char *serve_path = NULL;
+    int positional = 1;
+    for (int i = 1; i < argc; i++)
     {
-        fprintf(stderr, "Error: Starting and ending positions must have the same number of pieces.\n");
-        return 1;
-    }
-
-    // Check for valid piece positions and ensure they are unique
-    for (int i = 0; i < strlen(argv[1]); i++)
-    {
-        if (strchr(argv[1], argv[1][i]) != strrchr(argv[1], argv[1][i]))
+        if (strcmp(argv[i], "--pdb") == 0 && i + 1 < argc)
         {
-            fprintf(stderr, "Error: Duplicate piece positions in white pieces.\n");
-            return 1;
+            if (config.pdb_count == 2)
+            {
+                fprintf(stderr, "Error: At most 2 pattern databases can be loaded.\n");
+                return 1;
+            }
+            config.pdb_paths[config.pdb_count++] = argv[++i];
         }
-    }
-    for (int i = 0; i < strlen(argv[2]); i++)
-    {
-        if (strchr(argv[2], argv[2][i]) != strrchr(argv[2], argv[2][i]))
+        else if (strcmp(argv[i], "--tablebase") == 0 && i + 1 < argc)
         {
-            fprintf(stderr, "Error: Duplicate piece positions in black pieces.\n");
-            return 1;
+            if (config.tablebase_count == MAX_TABLEBASES)
+            {
+                fprintf(stderr, "Error: At most %d tablebases can be loaded.\n", MAX_TABLEBASES);
+                return 1;
+            }
+            config.tablebase_paths[config.tablebase_count++] = argv[++i];
         }
-    }
-    for (int i = 0; i < strlen(argv[3]); i++)
-    {
-        if (strchr(argv[3], argv[3][i]) != strrchr(argv[3], argv[3][i]))
+        else if (strcmp(argv[i], "--topology") == 0 && i + 1 < argc)
+            config.topology_path = argv[++i];
+        else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc)
+            serve_path = argv[++i];
+        else if (strcmp(argv[i], "--batch") == 0)
         {
-            fprintf(stderr, "Error: Duplicate goal positions in white pieces.\n");
-            return 1;
+            batch = 1;
+            // "-" is stdin, like no path at all
+            if (i + 1 < argc && (argv[i + 1][0] != '-' || strcmp(argv[i + 1], "-") == 0))
+                batch_path = argv[++i];
         }
-    }
-    for (int i = 0; i < strlen(argv[4]); i++)
-    {
-        if (strchr(argv[4], argv[4][i]) != strrchr(argv[4], argv[4][i]))
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
         {
-            fprintf(stderr, "Error: Duplicate goal positions in black pieces.\n");
-            return 1;
+            if (!parse_thread_count(argv[i], argv[i + 1], &config.threads))
+                return 1;
+            i++;
         }
-    }
-    // Check for valid piece positions
-    for (int i = 0; i < strlen(argv[1]); i++)
-    {
-        if (argv[1][i] < 'A' || argv[1][i] > 'N')
+        else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc)
         {
-            fprintf(stderr, "Error: Invalid piece position in white pieces: %c\n", argv[1][i]);
-            return 1;
+            if (!parse_thread_count(argv[i], argv[i + 1], &jobs))
+                return 1;
+            jobs_given = 1;
+            i++;
         }
-    }
-    for (int i = 0; i < strlen(argv[2]); i++)
-    {
-        if (argv[2][i] < 'A' || argv[2][i] > 'N')
+        else if (strcmp(argv[i], "--symmetry") == 0)
+            config.symmetry = 1;
+        else if (strcmp(argv[i], "--goal-cache") == 0 && i + 1 < argc)
         {
-            fprintf(stderr, "Error: Invalid piece position in black pieces: %c\n", argv[2][i]);
-            return 1;
+            uint64_t megabytes;
+            if (!parse_count(argv[++i], &megabytes) || megabytes > SIZE_MAX >> 20)
+            {
+                fprintf(stderr, "Error: --goal-cache takes a whole number of megabytes, not %s.\n", argv[i]);
+                return 1;
+            }
+            config.goal_cache = (size_t)megabytes << 20;
+        }
+        else if (strcmp(argv[i], "--memory") == 0 && i + 1 < argc)
+        {
+            if (!parse_megabytes(argv[++i], &config.external_memory))
+            {
+                fprintf(stderr, "Error: --memory takes a number of megabytes, not %s.\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--scratch") == 0 && i + 1 < argc)
+            config.scratch_dir = argv[++i];
+        else if (strcmp(argv[i], "--stats") == 0)
+            show_stats = 1;
+        else if (strcmp(argv[i], "--count-paths") == 0)
+            path_query = PATHS_COUNT;
+        else if (strcmp(argv[i], "--all-paths") == 0)
+            path_query = PATHS_ALL;
+        else if (strcmp(argv[i], "--path") == 0 && i + 1 < argc)
+        {
+            path_query = PATHS_INDEX;
+            if (!parse_count(argv[++i], &path_index))
+            {
+                fprintf(stderr, "Error: --path takes a path number, not %s.\n", argv[i]);
+                return 1;
+            }
         }
+        else if (strcmp(argv[i], "--bidirectional") == 0)
+            config.engine = ENGINE_BIDIRECTIONAL;
+        else if (strcmp(argv[i], "--layered") == 0)
+            config.engine = ENGINE_LAYERED;
+        else if (strcmp(argv[i], "--mod3") == 0)
+            config.engine = ENGINE_MOD3;
+        else if (strcmp(argv[i], "--astar") == 0)
+            config.engine = ENGINE_ASTAR;
+        else if (strcmp(argv[i], "--idastar") == 0)
+            config.engine = ENGINE_IDASTAR;
+        else if (strcmp(argv[i], "--external") == 0)
+            config.engine = ENGINE_EXTERNAL;
+        else
+            argv[positional++] = argv[i];
+    }
+    argc = positional;
+
+    if (argc != (batch || serve_path != NULL ? 1 : 5))
+    {
+        fprintf(stderr, "Usage: %s [--stats] [--topology file] [--symmetry | --threads N | --bidirectional | --layered | --mod3 | --astar | --idastar | --external [--memory MB] [--scratch dir]] [--pdb file]... [--tablebase file]... <white pieces> <black pieces> <white end> <black end>\n"
+                        "       %s [--count-paths | --all-paths | --path K] <white pieces> <black pieces> <white end> <black end>\n"
+                        "       %s [options] [--jobs N] [--goal-cache MB] --batch [file]\n"
+                        "       %s [options] [--jobs N] --serve <socket path>\n",
+                argv[0], argv[0], argv[0], argv[0]);
+        return 1;
+    }
+
+    // A single puzzle runs on one solver; --threads splits its search
+    if (jobs_given && !batch && serve_path == NULL)
+    {
+        fprintf(stderr, "Error: --jobs only applies to --batch and --serve.\n");
+        return 1;
+    }
+
+#ifndef HAS_BUILTIN_BOARD
+    if (config.topology_path == NULL)
+    {
+        fprintf(stderr, "Error: This build has %d cells and no built-in board; give one with --topology.\n",
+                NUM_POSITIONS);
+        return 1;
     }
-    for (int i = 0; i < strlen(argv[3]); i++)
+#endif
+
+    if (argc == 5)
     {
-        if (argv[3][i] < 'A' || argv[3][i] > 'N')
+        const char *pieces[4] = {argv[1], argv[2], argv[3], argv[4]};
+        char error[128];
+        if (!validate_puzzle(pieces, error, sizeof(error)))
         {
-            fprintf(stderr, "Error: Invalid goal position in white pieces: %c\n", argv[3][i]);
+            fprintf(stderr, "Error: %s.\n", error);
             return 1;
         }
     }
-    for (int i = 0; i < strlen(argv[4]); i++)
+    phase_ms[PHASE_VALIDATE] = monotonic_ms() - phase_start;
+#pragma endregion
+#pragma region Initialization
+    phase_start = monotonic_ms();
+    // Pattern databases feed the informed searches, A* unless IDA* was asked for
+    if (config.pdb_count > 0 && config.engine != ENGINE_IDASTAR)
+        config.engine = ENGINE_ASTAR;
+
+    if (config.threads > 1 && config.engine == ENGINE_BFS)
+        config.engine = ENGINE_PARALLEL_BFS;
+
+    Solver *solver = open_solver(&config);
+    if (solver == NULL)
+        return 1;
+    stats_out = show_stats ? stderr : NULL;
+    phase_ms[PHASE_INIT] = monotonic_ms() - phase_start;
+#pragma endregion
+
+    if (serve_path != NULL)
+    {
+        int ok = run_server(solver, &config, jobs, serve_path);
+        solver_destroy(solver);
+        return ok ? 0 : 1;
+    }
+
+    if (batch)
     {
-        if (argv[4][i] < 'A' || argv[4][i] > 'N')
+        FILE *input = (batch_path == NULL || strcmp(batch_path, "-") == 0) ? stdin : fopen(batch_path, "r");
+        if (input == NULL)
         {
-            fprintf(stderr, "Error: Invalid goal position in black pieces: %c\n", argv[4][i]);
+            perror(batch_path);
+            solver_destroy(solver);
             return 1;
         }
+        int ok = jobs > 1 ? run_parallel_batch(solver, &config, jobs, input) : run_batch(solver, input);
+        if (input != stdin)
+            fclose(input);
+        solver_destroy(solver);
+        end = clock();
+        cpu_time_used = ((double)(end - start)) / CLOCKS_PER_SEC;
+        fprintf(stderr, "Time taken: %f ms\n", cpu_time_used * 1000.0);
+        return ok ? 0 : 1;
     }
-#pragma endregion
-#pragma region Initialization
+
     const char *white_start = argv[1];
     const char *black_start = argv[2];
     const char *white_goal = argv[3];
     const char *black_goal = argv[4];
-    const int neighbors[NUM_POSITIONS][4] = {
-        /* A */ {1, -1, -1, -1},
-        /* B */ {0, 2, -1, -1},
-        /* C */ {1, 3, 11, -1},
-        /* D */ {2, 4, -1, -1},
-        /* E */ {3, 5, -1, -1},
-        /* F */ {4, 6, -1, -1},
-        /* G */ {5, -1, -1, -1},
-        /* H */ {8, -1, -1, -1},
-        /* I */ {7, 9, -1, -1},
-        /* J */ {8, 10, -1, -1},
-        /* K */ {9, 11, -1, -1},
-        /* L */ {2, 10, 12, -1},
-        /* M */ {11, 13, -1, -1},
-        /* N */ {12, -1, -1, -1}};
-    uint32_t board_start = init_board(white_start, black_start);
-    uint32_t board_goal = init_board(white_goal, black_goal);
-
-    Queue queue;
-    init_queue(&queue);
-    init_hash_table();
-    int goal_state = -1;
-    int *path = (int *)malloc(TABLE_SIZE * sizeof(int));
-    int path_length = 0;
-#pragma endregion
+    board_t board_start = init_board(white_start, black_start);
+    board_t board_goal = init_board(white_goal, black_goal);
 
-    insert_board_state(board_start);
-    generateNextState(&queue, board_start, neighbors, -1);
-    // print_board(board_start);
-
-#pragma region Main Loop
-    int iteration = 0;
-    while (!is_queue_empty(&queue))
+    // On the command line a database that does not fit the puzzle is a mistake
+    const char *mismatch = solver_check_tables(solver, board_goal);
+    if (mismatch != NULL)
     {
-        QueueNode *state = dequeue(&queue);
-        if (state == NULL)
-            break; // Queue is empty
-
-        uint32_t current_board = state->board;
-        int predecessor = state->predecessor;
-        int move = state->move;
-
-        set_predecessor(iteration, predecessor, move, current_board);
-
-        // Check if the current board matches the goal board
-        if (current_board == board_goal)
-        {
-            // printf("Goal state reached!\n");
-            // print_board(current_board);
-
-            goal_state = iteration;
-            reconstruct_path(iteration, path, &path_length);
+        fprintf(stderr, "Error: %s.\n", mismatch);
+        solver_destroy(solver);
+        return 1;
+    }
 
-            free(state);
-            break;
-        }
+    if (path_query != PATHS_NONE)
+    {
+        int ok = run_path_query(solver, path_query, path_index, board_start, board_goal);
+        solver_destroy(solver);
+        end = clock();
+        cpu_time_used = ((double)(end - start)) / CLOCKS_PER_SEC;
+        printf("Time taken: %f ms\n", cpu_time_used * 1000.0);
+        return ok ? 0 : 1;
+    }
 
-        generateNextState(&queue, current_board, neighbors, iteration++);
-        free(state);
-        // sleep(1);
+    const int *moves;
+    int move_count;
+    phase_start = monotonic_ms();
+    int found = solve(solver, board_start, board_goal, &moves, &move_count);
+    SearchStats stats = *solver_stats(solver);
+    phase_ms[PHASE_SEARCH] = monotonic_ms() - phase_start - stats.init_ms - stats.reconstruct_ms;
+    phase_ms[PHASE_INIT] += stats.init_ms;
+    phase_ms[PHASE_RECONSTRUCT] = stats.reconstruct_ms;
+    if (found < 0)
+    {
+        solver_destroy(solver);
+        return 1;
     }
-#pragma endregion
 
-    (goal_state == -1) ? printf("No solution found.\n") : print_path(path, path_length);
+    (found == 0) ? printf("No solution found.\n") : print_path(board_start, moves, move_count);
 
-    free_queue(&queue);
-    free_hash_table();
-    free(path);
+    phase_start = monotonic_ms();
+    solver_destroy(solver);
+    phase_ms[PHASE_TEARDOWN] = monotonic_ms() - phase_start;
+    if (show_stats)
+        print_stats(stderr, &stats, phase_ms);
     end = clock();
     cpu_time_used = ((double)(end - start)) / CLOCKS_PER_SEC;
     printf("Time taken: %f ms\n", cpu_time_used * 1000.0);
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,3259 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "solver.h"
+#include "board.h"
+#include "pattern_db.h"
+
+// The search engines behind solver.h. Everything a search touches lives in
+// its Solver or on the stack, so solvers on different threads never share
+// state.
+
+#pragma region Search Statistics
+static double monotonic_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// Time stamp counter ticks where the CPU has one, nanoseconds elsewhere
+static inline uint64_t read_cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static inline void note_queue_size(SearchStats *stats, unsigned long size)
+{
+    if (size > stats->peak_queue)
+        stats->peak_queue = size;
+}
+
+static inline void note_frontier(SearchStats *stats, int depth, unsigned long size)
+{
+    if (size == 0 || depth >= STATS_MAX_DEPTH)
+        return;
+    stats->frontier[depth] = size;
+    if (depth >= stats->depth_count)
+        stats->depth_count = depth + 1;
+}
+#pragma endregion
+
+#pragma region Queue Implementation
+// The frontier is a ring buffer of packed entries. Capacity is a power of two
+// so wrapping is a mask, and it doubles when full, so the search makes no
+// allocator calls per expanded state.
+#define QUEUE_INITIAL_CAPACITY 4096
+
+typedef struct QueueEntry
+{
+    board_t board;
+    int predecessor;
+    int move;
+} QueueEntry;
+
+typedef struct Queue
+{
+    QueueEntry *entries;
+    uint32_t capacity;
+    uint32_t head;
+    uint32_t size;
+} Queue;
+
+static int init_queue(Queue *queue)
+{
+    queue->entries = (QueueEntry *)malloc(QUEUE_INITIAL_CAPACITY * sizeof(QueueEntry));
+    if (queue->entries == NULL)
+    {
+        perror("Failed to allocate memory for queue");
+        return 0;
+    }
+    queue->capacity = QUEUE_INITIAL_CAPACITY;
+    queue->head = 0;
+    queue->size = 0;
+    return 1;
+}
+
+static inline int is_queue_empty(Queue *queue)
+{
+    return queue->size == 0;
+}
+
+static int grow_queue(Queue *queue)
+{
+    QueueEntry *entries = (QueueEntry *)realloc(queue->entries, 2 * queue->capacity * sizeof(QueueEntry));
+    if (entries == NULL)
+    {
+        perror("Failed to allocate memory for queue");
+        return 0;
+    }
+    // Move the wrapped part behind the old end so the entries stay contiguous
+    memcpy(entries + queue->capacity, entries, queue->head * sizeof(QueueEntry));
+    queue->entries = entries;
+    queue->capacity *= 2;
+    return 1;
+}
+
+// Returns 0 when the queue is full and cannot grow
+static inline int enqueue(Queue *queue, board_t board, int move, int predecessor)
+{
+    if (queue->size == queue->capacity && !grow_queue(queue))
+        return 0;
+
+    QueueEntry *entry = &queue->entries[(queue->head + queue->size) & (queue->capacity - 1)];
+    entry->board = board;
+    entry->move = move;
+    entry->predecessor = predecessor;
+    queue->size++;
+    return 1;
+}
+
+static inline QueueEntry dequeue(Queue *queue)
+{
+    QueueEntry entry = queue->entries[queue->head];
+    queue->head = (queue->head + 1) & (queue->capacity - 1);
+    queue->size--;
+    return entry;
+}
+
+static inline void reset_queue(Queue *queue)
+{
+    queue->head = 0;
+    queue->size = 0;
+}
+
+static void free_queue(Queue *queue)
+{
+    free(queue->entries);
+    queue->entries = NULL;
+    queue->capacity = 0;
+    queue->head = 0;
+    queue->size = 0;
+}
+
+static inline void print_queue(Queue *queue)
+{
+    printf("Queue: ");
+    for (uint32_t i = 0; i < queue->size; i++)
+    {
+        printf("%llx ", (unsigned long long)queue->entries[(queue->head + i) & (queue->capacity - 1)].board);
+    }
+    printf("\n");
+}
+#pragma endregion
+#pragma region Visited Set Implementation
+// The visited set is one bit per ranked state (see rank_board). With
+// symmetries set, a board and its images share the bit of their canonical
+// form (see canonical_board).
+typedef struct VisitedSet
+{
+    uint64_t *bits;
+    uint32_t size; // Number of ranked states
+    int symmetries;
+    unsigned long probes; // Lookups, for SearchStats
+} VisitedSet;
+
+static int init_visited_set(VisitedSet *visited, int whites, int blacks)
+{
+    visited->size = count_states(whites, blacks);
+    visited->symmetries = 0;
+    visited->probes = 0;
+    visited->bits = (uint64_t *)calloc((visited->size + 63) / 64, sizeof(uint64_t));
+    if (visited->bits == NULL)
+    {
+        perror("Failed to allocate memory for visited set");
+        return 0;
+    }
+    return 1;
+}
+
+// The bit a board and its images share
+static inline uint32_t visited_rank(const VisitedSet *visited, board_t board)
+{
+    return rank_board(canonical_board(board, visited->symmetries));
+}
+
+// Starts loading the word of a rank, to be tested a little later
+static inline void prefetch_visited(const VisitedSet *visited, uint32_t rank)
+{
+    __builtin_prefetch(&visited->bits[rank >> 6], 1);
+}
+
+// Marks the rank as visited and returns whether it had been seen before
+static inline int test_and_set_rank(VisitedSet *visited, uint32_t rank)
+{
+    uint64_t *word = &visited->bits[rank >> 6];
+    visited->probes++;
+    if (CHECK_BIT(*word, rank & 63))
+        return 1; // Found
+    SET_BIT(*word, rank & 63);
+    return 0; // Not found
+}
+
+static inline int test_and_set_visited(VisitedSet *visited, board_t board)
+{
+    return test_and_set_rank(visited, visited_rank(visited, board));
+}
+
+static inline void clear_visited(VisitedSet *visited, board_t board)
+{
+    uint32_t rank = rank_board(canonical_board(board, visited->symmetries));
+    CLEAR_BIT(visited->bits[rank >> 6], rank & 63);
+}
+
+static void free_visited_set(VisitedSet *visited)
+{
+    free(visited->bits);
+    visited->bits = NULL;
+    visited->size = 0;
+}
+#pragma endregion
+#pragma region Predecessor Table Implementation
+typedef struct Predecessor
+{
+    board_t board;
+    int predecessor;
+    int move;
+} Predecessor;
+
+// Each solver owns a table with an entry per board (see reserve_tables),
+// indexed by the order in which the BFS dequeued the boards
+
+static inline void set_predecessor(Predecessor *predecessors, int index, int predecessor, int move, board_t board)
+{
+    predecessors[index].board = board;
+    predecessors[index].predecessor = predecessor;
+    predecessors[index].move = move;
+}
+
+static void reconstruct_path(const Predecessor *predecessors, int goal_index, int moves[], int *move_count)
+{
+    if (moves == NULL || move_count == NULL)
+    {
+        fprintf(stderr, "[Error]: Null pointer passed to reconstructPath.\n");
+        return;
+    }
+
+    // Reconstruct the moves from the goal index back to the start
+    int current_index = goal_index;
+    int index = 0;
+    while (current_index != -1)
+    {
+        // printf("Current index: %d\n", current_index);
+        moves[index] = predecessors[current_index].move;
+        current_index = predecessors[current_index].predecessor;
+        index++;
+    }
+
+    *move_count = index;
+
+    // Reverse the moves to get them from start to goal
+    for (int i = 0; i < *move_count / 2; i++)
+    {
+        int temp = moves[i];
+        moves[i] = moves[*move_count - 1 - i];
+        moves[*move_count - 1 - i] = temp;
+    }
+}
+
+#pragma endregion
+
+// Boards the BFS expands together. Their children are all generated and
+// the visited words they need prefetched before the first one is tested, so
+// once the bitmap outgrows the cache tens of misses overlap instead of each
+// probe waiting for the one before. 1 tests each child as it is generated.
+#ifndef BFS_BATCH
+#define BFS_BATCH 16
+#endif
+
+typedef struct ExpansionBatch
+{
+    board_t children[BFS_BATCH * MAX_CHILDREN];
+    int moves[BFS_BATCH * MAX_CHILDREN];
+    uint32_t ranks[BFS_BATCH * MAX_CHILDREN];
+    int counts[BFS_BATCH]; // Children of each board
+} ExpansionBatch;
+
+// Expands count boards whose predecessor indices run from first_predecessor.
+// Children are tested and queued in the same order as expanding the boards
+// one at a time would, so the search is unchanged. Returns 0 when the queue
+// cannot grow, leaving only queued boards marked visited.
+static inline int generateNextState(Queue *queue, VisitedSet *visited, const board_t boards[], int count,
+                                     const int neighbors[NUM_POSITIONS][4], int first_predecessor,
+                                     ExpansionBatch *batch, SearchStats *stats)
+{
+    int total = 0;
+    for (int b = 0; b < count; b++)
+    {
+        batch->counts[b] = generate_children(boards[b], neighbors, batch->children + total, batch->moves + total);
+        total += batch->counts[b];
+    }
+    for (int i = 0; i < total; i++)
+    {
+        batch->ranks[i] = visited_rank(visited, batch->children[i]);
+        prefetch_visited(visited, batch->ranks[i]);
+    }
+    stats->expanded += count;
+    stats->generated += total;
+
+    int i = 0;
+    for (int b = 0; b < count; b++)
+    {
+        for (int end = i + batch->counts[b]; i < end; i++)
+        {
+            if (test_and_set_rank(visited, batch->ranks[i]))
+            {
+                stats->duplicates++;
+            }
+            else if (!enqueue(queue, batch->children[i], batch->moves[i], first_predecessor + b))
+            {
+                clear_visited(visited, batch->children[i]);
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+// Searches that index by rank record the move that first reached each state
+// in a move_t, a byte on boards of up to 15 cells (see board_type.h)
+#define MOVE_UNSEEN ((move_t)~0)
+#define MOVE_ROOT ((move_t)~1)
+
+// Walks reached_by back from board to the root and appends the moves, in
+// playing order, after the first *move_count entries of moves[]
+static void trace_moves(const move_t *reached_by, board_t board, int moves[], int *move_count, SearchStats *stats)
+{
+    double start = monotonic_ms();
+    int first = *move_count;
+    int move;
+    while ((move = reached_by[rank_board(board)]) != MOVE_ROOT)
+    {
+        moves[(*move_count)++] = move;
+        board = undo_move(board, move);
+    }
+    for (int i = first, j = *move_count - 1; i < j; i++, j--)
+    {
+        int temp = moves[i];
+        moves[i] = moves[j];
+        moves[j] = temp;
+    }
+    stats->reconstruct_ms += monotonic_ms() - start;
+}
+
+// Turns a path from a to b into the path from b to a: the same moves in
+// reverse order, each played backwards
+static void reverse_path(int moves[], int move_count)
+{
+    for (int i = 0, j = move_count - 1; i <= j; i++, j--)
+    {
+        int first = reverse_move(moves[j]);
+        moves[j] = reverse_move(moves[i]);
+        moves[i] = first;
+    }
+}
+
+#pragma region Breadth-First Search
+// Uses the queue and visited set passed in, and hands them back empty: only
+// the bits this search set are cleared, so a batch of puzzles never pays for
+// wiping the whole bitmap. Returns 1 when the goal is found, 0 when it cannot
+// be reached and -1 when the queue cannot grow.
+static int solve_bfs(Queue *queue, VisitedSet *visited, Predecessor *predecessors, board_t board_start,
+                     board_t board_goal, const int neighbors[NUM_POSITIONS][4], int moves[], int *move_count,
+                     SearchStats *stats)
+{
+    int found = 0;
+    *move_count = 0;
+    if (board_start == board_goal)
+        found = 1;
+
+    ExpansionBatch batch;
+    test_and_set_visited(visited, board_start);
+    if (!generateNextState(queue, visited, &board_start, 1, neighbors, -1, &batch, stats))
+        found = -1;
+    // print_board(board_start);
+
+    // The queue holds one layer followed by part of the next, so the next
+    // layer is complete once the current one has been dequeued
+    uint32_t layer_left = queue->size;
+    int depth = 1;
+    note_frontier(stats, 0, 1);
+    note_frontier(stats, depth, layer_left);
+
+    board_t boards[BFS_BATCH];
+    int dequeued = 0;
+    while (!found && !is_queue_empty(queue))
+    {
+        // A batch stops at the end of the layer, so that the queue then holds
+        // exactly the next one
+        int first = dequeued;
+        int count = 0;
+        uint32_t limit = layer_left < BFS_BATCH ? layer_left : BFS_BATCH;
+        while (count < limit)
+        {
+            QueueEntry state = dequeue(queue);
+            set_predecessor(predecessors, dequeued, state.predecessor, state.move, state.board);
+
+            // Check if the current board matches the goal board
+            if (state.board == board_goal)
+            {
+                double reconstruct_start = monotonic_ms();
+                reconstruct_path(predecessors, dequeued, moves, move_count);
+                stats->reconstruct_ms += monotonic_ms() - reconstruct_start;
+                dequeued++;
+                found = 1;
+                break;
+            }
+            boards[count++] = state.board;
+            dequeued++;
+        }
+        if (found)
+            break;
+
+        if (!generateNextState(queue, visited, boards, count, neighbors, first, &batch, stats))
+        {
+            found = -1;
+            break;
+        }
+        note_queue_size(stats, queue->size);
+        layer_left -= count;
+        if (layer_left == 0)
+        {
+            layer_left = queue->size;
+            note_frontier(stats, ++depth, layer_left);
+        }
+    }
+
+    // Every visited board is the start, a dequeued board or still queued
+    clear_visited(visited, board_start);
+    for (int i = 0; i < dequeued; i++)
+        clear_visited(visited, predecessors[i].board);
+    while (!is_queue_empty(queue))
+        clear_visited(visited, dequeue(queue).board);
+    reset_queue(queue);
+    return found;
+}
+#pragma endregion
+#pragma region Bidirectional Search
+// Moves are reversible, so a second frontier is grown from the goal and the
+// search stops as soon as the two touch. Each side records, per ranked state,
+// the move that first reached it; both half-paths are rebuilt by undoing those
+// moves back to their root.
+
+typedef struct SearchSide
+{
+    Queue queue;
+    move_t *moves; // Move that reached each ranked state
+} SearchSide;
+
+static int init_search_side(SearchSide *side, board_t root, uint32_t size)
+{
+    if (!init_queue(&side->queue))
+        return 0;
+    side->moves = (move_t *)malloc(size * sizeof(move_t));
+    if (side->moves == NULL)
+    {
+        perror("Failed to allocate memory for search side");
+        free_queue(&side->queue);
+        return 0;
+    }
+    memset(side->moves, 0xFF, size * sizeof(move_t)); // MOVE_UNSEEN
+    side->moves[rank_board(root)] = MOVE_ROOT;
+    enqueue(&side->queue, root, MOVE_ROOT, -1); // The queue starts with room
+    return 1;
+}
+
+static void free_search_side(SearchSide *side)
+{
+    free_queue(&side->queue);
+    free(side->moves);
+    side->moves = NULL;
+}
+
+// Expands one whole BFS layer of a side. Returns 1 and the meeting board once
+// a child has already been reached from the other side, and -1 when the
+// queue cannot grow.
+static int expand_search_side(SearchSide *side, const SearchSide *other, const int neighbors[NUM_POSITIONS][4],
+                              board_t *meeting, SearchStats *stats)
+{
+    board_t children[MAX_CHILDREN];
+    int child_moves[MAX_CHILDREN];
+    for (uint32_t layer = side->queue.size; layer > 0; layer--)
+    {
+        QueueEntry state = dequeue(&side->queue);
+        int count = generate_children(state.board, neighbors, children, child_moves);
+        stats->expanded++;
+        stats->generated += count;
+        for (int i = 0; i < count; i++)
+        {
+            uint32_t rank = rank_board(children[i]);
+            if (side->moves[rank] != MOVE_UNSEEN)
+            {
+                stats->duplicates++;
+                continue;
+            }
+            side->moves[rank] = child_moves[i];
+            if (other->moves[rank] != MOVE_UNSEEN)
+            {
+                *meeting = children[i];
+                return 1;
+            }
+            if (!enqueue(&side->queue, children[i], child_moves[i], -1))
+                return -1;
+        }
+    }
+    return 0;
+}
+
+static int solve_bidirectional(board_t board_start, board_t board_goal, const int neighbors[NUM_POSITIONS][4],
+                               int whites, int blacks, int moves[], int *move_count, SearchStats *stats)
+{
+    uint32_t size = count_states(whites, blacks);
+    SearchSide forward, backward;
+    if (!init_search_side(&forward, board_start, size))
+        return -1;
+    if (!init_search_side(&backward, board_goal, size))
+    {
+        free_search_side(&forward);
+        return -1;
+    }
+
+    int found = 0;
+    board_t meeting = board_start;
+    if (board_start == board_goal)
+        found = 1;
+    while (!found && !is_queue_empty(&forward.queue) && !is_queue_empty(&backward.queue))
+    {
+        // Always grow the smaller frontier
+        if (forward.queue.size <= backward.queue.size)
+            found = expand_search_side(&forward, &backward, neighbors, &meeting, stats);
+        else
+            found = expand_search_side(&backward, &forward, neighbors, &meeting, stats);
+        note_queue_size(stats, forward.queue.size + backward.queue.size);
+    }
+
+    *move_count = 0;
+    if (found > 0)
+    {
+        trace_moves(forward.moves, meeting, moves, move_count, stats);
+
+        // The backward half is already in order, each move played in reverse
+        board_t board = meeting;
+        int move;
+        while ((move = backward.moves[rank_board(board)]) != MOVE_ROOT)
+        {
+            moves[(*move_count)++] = reverse_move(move);
+            board = undo_move(board, move);
+        }
+    }
+
+    free_search_side(&forward);
+    free_search_side(&backward);
+    return found;
+}
+#pragma endregion
+
+#pragma region Parallel Breadth-First Search
+// Level-synchronous BFS over worker threads. Each layer is handed out in
+// chunks through an atomic cursor; workers claim children in a shared
+// visited bitmap with an atomic OR on its 64-bit words, so exactly one thread
+// wins each new board, records the move that reached it and appends it to
+// its own buffer. Between layers the buffers are concatenated into the next
+// frontier. Paths come from the per-rank move bytes, as in the other
+// rank-indexed searches.
+#define PARALLEL_CHUNK 256
+
+typedef struct LayerBuffer
+{
+    board_t *boards;
+    uint32_t count;
+    uint32_t capacity;
+    unsigned long generated; // Counted per thread and added up between layers
+    unsigned long duplicates;
+} LayerBuffer;
+
+typedef struct ParallelSearch
+{
+    const int (*neighbors)[4];
+    uint64_t *visited;   // One bit per ranked state, set atomically
+    move_t *reached_by; // Written only by the thread that set the bit
+    const board_t *frontier;
+    uint32_t frontier_size;
+    uint32_t cursor; // Next unclaimed frontier index
+    LayerBuffer *buffers;
+    int thread_count;
+    int done;
+    int failed;
+    pthread_mutex_t start_lock; // Held until the barrier knows how many threads started
+    pthread_barrier_t barrier;
+} ParallelSearch;
+
+typedef struct ParallelWorker
+{
+    ParallelSearch *search;
+    int id;
+} ParallelWorker;
+
+static int push_layer_buffer(LayerBuffer *buffer, board_t board)
+{
+    if (buffer->count == buffer->capacity)
+    {
+        uint32_t capacity = buffer->capacity ? 2 * buffer->capacity : QUEUE_INITIAL_CAPACITY;
+        board_t *boards = (board_t *)realloc(buffer->boards, capacity * sizeof(board_t));
+        if (boards == NULL)
+            return 0;
+        buffer->boards = boards;
+        buffer->capacity = capacity;
+    }
+    buffer->boards[buffer->count++] = board;
+    return 1;
+}
+
+static void expand_layer(ParallelSearch *search, int id)
+{
+    LayerBuffer *buffer = &search->buffers[id];
+    board_t children[MAX_CHILDREN];
+    int child_moves[MAX_CHILDREN];
+    buffer->count = 0;
+    buffer->generated = 0;
+    buffer->duplicates = 0;
+
+    uint32_t begin;
+    while ((begin = __atomic_fetch_add(&search->cursor, PARALLEL_CHUNK, __ATOMIC_RELAXED)) < search->frontier_size)
+    {
+        uint32_t end = begin + PARALLEL_CHUNK < search->frontier_size ? begin + PARALLEL_CHUNK : search->frontier_size;
+        for (uint32_t f = begin; f < end; f++)
+        {
+            int count = generate_children(search->frontier[f], search->neighbors, children, child_moves);
+            buffer->generated += count;
+            for (int i = 0; i < count; i++)
+            {
+                uint32_t rank = rank_board(children[i]);
+                uint64_t *word = &search->visited[rank >> 6];
+                uint64_t bit = 1ULL << (rank & 63);
+                // A plain load first keeps already-seen boards off the bus
+                if ((__atomic_load_n(word, __ATOMIC_RELAXED) & bit) ||
+                    (__atomic_fetch_or(word, bit, __ATOMIC_RELAXED) & bit))
+                {
+                    buffer->duplicates++;
+                    continue;
+                }
+                search->reached_by[rank] = child_moves[i];
+                if (!push_layer_buffer(buffer, children[i]))
+                {
+                    __atomic_store_n(&search->failed, 1, __ATOMIC_RELAXED);
+                    return;
+                }
+            }
+        }
+    }
+}
+
+// Threads other than the caller wait at the barrier for each layer, expand
+// it, and meet the caller again once it is done
+static void *parallel_worker(void *arg)
+{
+    ParallelWorker *worker = (ParallelWorker *)arg;
+    ParallelSearch *search = worker->search;
+    pthread_mutex_lock(&search->start_lock);
+    pthread_mutex_unlock(&search->start_lock);
+    for (;;)
+    {
+        pthread_barrier_wait(&search->barrier);
+        if (search->done)
+            break;
+        expand_layer(search, worker->id);
+        pthread_barrier_wait(&search->barrier);
+    }
+    return NULL;
+}
+
+static int solve_parallel_bfs(board_t board_start, board_t board_goal, const int neighbors[NUM_POSITIONS][4],
+                              int whites, int blacks, int thread_count, int moves[], int *move_count,
+                              SearchStats *stats)
+{
+    uint32_t size = count_states(whites, blacks);
+    ParallelSearch search;
+    memset(&search, 0, sizeof(search));
+    search.neighbors = neighbors;
+    search.thread_count = thread_count;
+    search.visited = (uint64_t *)calloc((size + 63) / 64, sizeof(uint64_t));
+    search.reached_by = (move_t *)malloc(size * sizeof(move_t));
+    search.buffers = (LayerBuffer *)calloc(thread_count, sizeof(LayerBuffer));
+    board_t *frontier = (board_t *)malloc(size * sizeof(board_t));
+    board_t *next = (board_t *)malloc(size * sizeof(board_t));
+    pthread_t *threads = (pthread_t *)malloc(thread_count * sizeof(pthread_t));
+    ParallelWorker *workers = (ParallelWorker *)malloc(thread_count * sizeof(ParallelWorker));
+    if (search.visited == NULL || search.reached_by == NULL || search.buffers == NULL || frontier == NULL ||
+        next == NULL || threads == NULL || workers == NULL)
+    {
+        perror("Failed to allocate memory for parallel search");
+        free(search.visited);
+        free(search.reached_by);
+        free(search.buffers);
+        free(frontier);
+        free(next);
+        free(threads);
+        free(workers);
+        return -1;
+    }
+    memset(search.reached_by, 0xFF, size * sizeof(move_t)); // MOVE_UNSEEN
+
+    uint32_t rank = rank_board(board_start);
+    SET_BIT(search.visited[rank >> 6], rank & 63);
+    search.reached_by[rank] = MOVE_ROOT;
+    frontier[0] = board_start;
+    uint32_t frontier_size = 1;
+    int depth = 0;
+    note_frontier(stats, depth, frontier_size);
+
+    // If the system runs out of threads, search with the ones that started
+    int started = 1;
+    pthread_mutex_init(&search.start_lock, NULL);
+    pthread_mutex_lock(&search.start_lock);
+    for (int i = 1; i < thread_count; i++)
+    {
+        workers[i].search = &search;
+        workers[i].id = i;
+        if (pthread_create(&threads[i], NULL, parallel_worker, &workers[i]) != 0)
+            break;
+        started++;
+    }
+    pthread_barrier_init(&search.barrier, NULL, started);
+    pthread_mutex_unlock(&search.start_lock);
+
+    uint32_t goal_rank = rank_board(board_goal);
+    while (search.reached_by[goal_rank] == MOVE_UNSEEN && frontier_size > 0 && !search.failed)
+    {
+        search.frontier = frontier;
+        search.frontier_size = frontier_size;
+        search.cursor = 0;
+        stats->expanded += frontier_size;
+        pthread_barrier_wait(&search.barrier);
+        expand_layer(&search, 0);
+        pthread_barrier_wait(&search.barrier);
+
+        frontier_size = 0;
+        for (int i = 0; i < started; i++)
+        {
+            memcpy(next + frontier_size, search.buffers[i].boards, search.buffers[i].count * sizeof(board_t));
+            frontier_size += search.buffers[i].count;
+            stats->generated += search.buffers[i].generated;
+            stats->duplicates += search.buffers[i].duplicates;
+        }
+        note_frontier(stats, ++depth, frontier_size);
+        note_queue_size(stats, frontier_size);
+        board_t *swap = frontier;
+        frontier = next;
+        next = swap;
+    }
+    search.done = 1;
+    pthread_barrier_wait(&search.barrier);
+    for (int i = 1; i < started; i++)
+        pthread_join(threads[i], NULL);
+    pthread_barrier_destroy(&search.barrier);
+    pthread_mutex_destroy(&search.start_lock);
+
+    int found = search.failed ? -1 : search.reached_by[goal_rank] != MOVE_UNSEEN;
+    if (search.failed)
+        fprintf(stderr, "Failed to allocate memory for parallel search layer\n");
+    *move_count = 0;
+    if (found == 1)
+        trace_moves(search.reached_by, board_goal, moves, move_count, stats);
+
+    for (int i = 0; i < thread_count; i++)
+        free(search.buffers[i].boards);
+    free(search.visited);
+    free(search.reached_by);
+    free(search.buffers);
+    free(frontier);
+    free(next);
+    free(threads);
+    free(workers);
+    return found;
+}
+#pragma endregion
+
+#pragma region Layered Search
+// Moves are reversible, so every neighbour of a board in layer k lies in
+// layer k - 1, k or k + 1. Checking children against the previous and
+// current layers is enough to find the new ones, and nothing older is kept:
+// memory is three layers, held as sorted arrays searched by bisection.
+// Without predecessors the path is rebuilt by divide and conquer: the boards
+// at depth h from the start and at depth d - h from the goal meet in a board
+// on a shortest path, and each half is solved the same way.
+#define LAYER_NO_GOAL ((board_t)0b10) // No real board has the 10 pattern
+
+typedef struct Layer
+{
+    board_t *boards; // Sorted, no duplicates
+    uint32_t count;
+    uint32_t capacity;
+} Layer;
+
+typedef struct LayeredSearch
+{
+    Layer layers[3];
+    Layer *previous;
+    Layer *current;
+    Layer *next;
+    int failed; // Out of memory
+    SearchStats *stats;
+} LayeredSearch;
+
+static void init_layered_search(LayeredSearch *search, SearchStats *stats)
+{
+    memset(search, 0, sizeof(*search));
+    search->stats = stats;
+}
+
+static void free_layered_search(LayeredSearch *search)
+{
+    for (int i = 0; i < 3; i++)
+        free(search->layers[i].boards);
+    memset(search, 0, sizeof(*search));
+}
+
+static int compare_boards(const void *a, const void *b)
+{
+    board_t x = *(const board_t *)a, y = *(const board_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int layer_contains(const Layer *layer, board_t board)
+{
+    uint32_t low = 0, high = layer->count;
+    while (low < high)
+    {
+        uint32_t mid = low + (high - low) / 2;
+        if (layer->boards[mid] < board)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low < layer->count && layer->boards[low] == board;
+}
+
+static int push_layer(Layer *layer, board_t board)
+{
+    if (layer->count == layer->capacity)
+    {
+        uint32_t capacity = layer->capacity ? 2 * layer->capacity : QUEUE_INITIAL_CAPACITY;
+        board_t *boards = (board_t *)realloc(layer->boards, capacity * sizeof(board_t));
+        if (boards == NULL)
+        {
+            perror("Failed to allocate memory for search layer");
+            return 0;
+        }
+        layer->boards = boards;
+        layer->capacity = capacity;
+    }
+    layer->boards[layer->count++] = board;
+    return 1;
+}
+
+// Fills search->next with the boards one move beyond the current layer
+static int advance_layer(LayeredSearch *search, const int neighbors[NUM_POSITIONS][4])
+{
+    board_t children[MAX_CHILDREN];
+    int child_moves[MAX_CHILDREN];
+    Layer *next = search->next;
+    next->count = 0;
+    SearchStats *stats = search->stats;
+    stats->expanded += search->current->count;
+    for (uint32_t b = 0; b < search->current->count; b++)
+    {
+        int count = generate_children(search->current->boards[b], neighbors, children, child_moves);
+        stats->generated += count;
+        for (int i = 0; i < count; i++)
+        {
+            if (layer_contains(search->current, children[i]) || layer_contains(search->previous, children[i]))
+            {
+                stats->duplicates++;
+                continue;
+            }
+            if (!push_layer(next, children[i]))
+                return 0;
+        }
+    }
+
+    qsort(next->boards, next->count, sizeof(board_t), compare_boards);
+    uint32_t unique = 0;
+    for (uint32_t i = 0; i < next->count; i++)
+    {
+        if (unique == 0 || next->boards[i] != next->boards[unique - 1])
+            next->boards[unique++] = next->boards[i];
+    }
+    stats->duplicates += next->count - unique;
+    next->count = unique;
+
+    Layer *oldest = search->previous;
+    search->previous = search->current;
+    search->current = next;
+    search->next = oldest;
+    return 1;
+}
+
+// Runs the search from root until the current layer holds goal or is the
+// one at max_depth. Returns that depth, or -1 when the boards run out first
+// (or memory does, which sets search->failed).
+static int run_layers(LayeredSearch *search, board_t root, board_t goal, int max_depth,
+                      const int neighbors[NUM_POSITIONS][4])
+{
+    search->previous = &search->layers[0];
+    search->current = &search->layers[1];
+    search->next = &search->layers[2];
+    search->previous->count = 0;
+    search->current->count = 0;
+    if (!push_layer(search->current, root))
+    {
+        search->failed = 1;
+        return -1;
+    }
+
+    // Only the run towards the real goal is the search itself; the others
+    // rebuild the path
+    int depth = 0;
+    int counted = goal != LAYER_NO_GOAL;
+    SearchStats *stats = search->stats;
+    if (counted)
+        note_frontier(stats, depth, 1);
+    while (depth < max_depth && !layer_contains(search->current, goal))
+    {
+        if (!advance_layer(search, neighbors))
+        {
+            search->failed = 1;
+            return -1;
+        }
+        if (search->current->count == 0)
+            return -1;
+        depth++;
+        if (counted)
+        {
+            note_frontier(stats, depth, search->current->count);
+            note_queue_size(stats, search->current->count);
+        }
+    }
+    return depth;
+}
+
+// Writes a shortest path of distance moves from board_start to board_goal
+static int layered_path(LayeredSearch *forward, LayeredSearch *backward, board_t board_start,
+                        board_t board_goal, int distance, const int neighbors[NUM_POSITIONS][4], int moves[])
+{
+    if (distance == 0)
+        return 1;
+    if (distance == 1)
+    {
+        board_t children[MAX_CHILDREN];
+        int child_moves[MAX_CHILDREN];
+        int count = generate_children(board_start, neighbors, children, child_moves);
+        for (int i = 0; i < count; i++)
+        {
+            if (children[i] == board_goal)
+            {
+                moves[0] = child_moves[i];
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    int half = distance / 2;
+    if (run_layers(forward, board_start, LAYER_NO_GOAL, half, neighbors) != half ||
+        run_layers(backward, board_goal, LAYER_NO_GOAL, distance - half, neighbors) != distance - half)
+        return 0;
+
+    // Any board in both layers splits the path
+    const Layer *a = forward->current, *b = backward->current;
+    uint32_t i = 0, j = 0;
+    while (i < a->count && j < b->count && a->boards[i] != b->boards[j])
+    {
+        if (a->boards[i] < b->boards[j])
+            i++;
+        else
+            j++;
+    }
+    if (i == a->count || j == b->count)
+        return 0;
+    board_t middle = a->boards[i];
+
+    return layered_path(forward, backward, board_start, middle, half, neighbors, moves) &&
+           layered_path(forward, backward, middle, board_goal, distance - half, neighbors, moves + half);
+}
+
+static int solve_layered(board_t board_start, board_t board_goal, const int neighbors[NUM_POSITIONS][4],
+                         int moves[], int *move_count, SearchStats *stats)
+{
+    LayeredSearch forward, backward;
+    init_layered_search(&forward, stats);
+    init_layered_search(&backward, stats);
+
+    int found = 0;
+    *move_count = 0;
+    int distance = run_layers(&forward, board_start, board_goal, INT_MAX, neighbors);
+    if (distance >= 0)
+    {
+        double reconstruct_start = monotonic_ms();
+        found = layered_path(&forward, &backward, board_start, board_goal, distance, neighbors, moves);
+        stats->reconstruct_ms += monotonic_ms() - reconstruct_start;
+        if (found)
+            *move_count = distance;
+    }
+    if (forward.failed || backward.failed)
+        found = -1;
+
+    free_layered_search(&forward);
+    free_layered_search(&backward);
+    return found;
+}
+#pragma endregion
+
+#pragma region External-Memory Search
+// The layered search with its layers on disk, for state spaces that do not
+// fit in memory. Every layer is a scratch file of sorted, distinct boards.
+// Children of the current layer collect in a buffer; each time it fills, it
+// is sorted and written out as a run. At the end of the layer the runs are
+// merged in one streaming pass that also drops every board found in the
+// previous and current layer files, which is delayed duplicate detection:
+// nothing is looked up while children are generated. When there are more
+// runs than the memory cap has read buffers for, they are first merged in
+// groups. Memory stays within the cap, which is at least EXTERNAL_BLOCKS
+// blocks of EXTERNAL_BLOCK_MIN bytes, whatever the layer sizes, and all I/O
+// is sequential in whole blocks except for the walk back from the goal,
+// which finds one board per layer by bisection in the kept layer files.
+#define EXTERNAL_BLOCK_MAX (1 << 20) // Bytes per read or write
+#define EXTERNAL_BLOCK_MIN (EXTERNAL_MIN_MEMORY / EXTERNAL_BLOCKS)
+#define EXTERNAL_BLOCKS 16                       // The cap is split into this many blocks to merge
+#define EXTERNAL_MERGE_WAY (EXTERNAL_BLOCKS - 3) // Less two layers being read and the output
+
+typedef struct BoardReader
+{
+    int fd;
+    off_t offset;  // Of the next block in the file
+    uint64_t left; // Boards not yet read into block
+    board_t *block;
+    size_t block_boards;
+    size_t count; // Boards in block
+    size_t next;
+} BoardReader;
+
+typedef struct BoardWriter
+{
+    int fd;
+    off_t offset;
+    board_t *block;
+    size_t block_boards;
+    size_t count;     // Boards in block
+    uint64_t written; // Boards, including those still in block
+    SearchStats *stats;
+} BoardWriter;
+
+typedef struct Run
+{
+    off_t offset;
+    uint64_t count;
+} Run;
+
+typedef struct RunList
+{
+    int fd;
+    Run *runs;
+    int count;
+    int capacity;
+    off_t end;
+} RunList;
+
+typedef struct ExternalLayer
+{
+    int fd;
+    uint64_t count;
+} ExternalLayer;
+
+typedef struct ExternalSearch
+{
+    board_t *memory; // The whole cap, carved into blocks
+    size_t memory_boards;
+    size_t block_boards;
+    ExternalLayer *layers; // One per depth, kept for the walk back
+    int layer_count;
+    int layer_capacity;
+    RunList runs[2]; // The runs of the next layer, and those merged from them
+    const char *scratch_dir;
+    SearchStats *stats;
+} ExternalSearch;
+
+// Opens a scratch file in dir that is gone once closed, or prints why and
+// returns -1
+static int open_scratch_file(const char *dir)
+{
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/solver-XXXXXX", dir);
+    int fd = mkstemp(path);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Error: Cannot create a scratch file in %s: %s.\n", dir, strerror(errno));
+        return -1;
+    }
+    unlink(path);
+    return fd;
+}
+
+static void open_reader(BoardReader *reader, int fd, off_t offset, uint64_t count, board_t *block,
+                        size_t block_boards)
+{
+    reader->fd = fd;
+    reader->offset = offset;
+    reader->left = count;
+    reader->block = block;
+    reader->block_boards = block_boards;
+    reader->count = reader->next = 0;
+}
+
+// Returns 1 with the next board in *board, 0 at the end and -1 on a read error
+static int peek_board(BoardReader *reader, board_t *board)
+{
+    if (reader->next == reader->count)
+    {
+        if (reader->left == 0)
+            return 0;
+        size_t count = reader->left < reader->block_boards ? (size_t)reader->left : reader->block_boards;
+        size_t bytes = count * sizeof(board_t);
+        if (pread(reader->fd, reader->block, bytes, reader->offset) != (ssize_t)bytes)
+        {
+            perror("Failed to read scratch file");
+            return -1;
+        }
+        reader->offset += bytes;
+        reader->left -= count;
+        reader->count = count;
+        reader->next = 0;
+    }
+    *board = reader->block[reader->next];
+    return 1;
+}
+
+// Moves a sorted reader up to board. Returns 1 when it holds board, 0 when
+// not and -1 on a read error.
+static int skip_to_board(BoardReader *reader, board_t board)
+{
+    board_t other;
+    int status;
+    while ((status = peek_board(reader, &other)) == 1 && other < board)
+        reader->next++;
+    return status < 0 ? -1 : status == 1 && other == board;
+}
+
+static void open_writer(BoardWriter *writer, int fd, off_t offset, board_t *block, size_t block_boards,
+                        SearchStats *stats)
+{
+    writer->fd = fd;
+    writer->offset = offset;
+    writer->block = block;
+    writer->block_boards = block_boards;
+    writer->count = 0;
+    writer->written = 0;
+    writer->stats = stats;
+}
+
+static int write_boards(int fd, const board_t *boards, size_t count, off_t offset, SearchStats *stats)
+{
+    size_t bytes = count * sizeof(board_t);
+    if (bytes > 0 && pwrite(fd, boards, bytes, offset) != (ssize_t)bytes)
+    {
+        perror("Failed to write scratch file");
+        return 0;
+    }
+    stats->disk_bytes += bytes;
+    return 1;
+}
+
+static int flush_writer(BoardWriter *writer)
+{
+    if (!write_boards(writer->fd, writer->block, writer->count, writer->offset, writer->stats))
+        return 0;
+    writer->offset += writer->count * sizeof(board_t);
+    writer->count = 0;
+    return 1;
+}
+
+static inline int write_board(BoardWriter *writer, board_t board)
+{
+    writer->block[writer->count++] = board;
+    writer->written++;
+    return writer->count < writer->block_boards || flush_writer(writer);
+}
+
+static int push_run(RunList *list, off_t offset, uint64_t count)
+{
+    if (list->count == list->capacity)
+    {
+        int capacity = list->capacity ? 2 * list->capacity : 64;
+        Run *runs = (Run *)realloc(list->runs, capacity * sizeof(Run));
+        if (runs == NULL)
+        {
+            perror("Failed to allocate memory for runs");
+            return 0;
+        }
+        list->runs = runs;
+        list->capacity = capacity;
+    }
+    list->runs[list->count].offset = offset;
+    list->runs[list->count].count = count;
+    list->count++;
+    list->end = offset + count * sizeof(board_t);
+    return 1;
+}
+
+// Sorts count boards and appends them, without repeats, as a run of list
+static int write_run(RunList *list, board_t boards[], size_t count, SearchStats *stats)
+{
+    qsort(boards, count, sizeof(board_t), compare_boards);
+    size_t unique = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (unique == 0 || boards[i] != boards[unique - 1])
+            boards[unique++] = boards[i];
+    }
+    stats->duplicates += count - unique;
+    stats->runs++;
+    return write_boards(list->fd, boards, unique, list->end, stats) && push_run(list, list->end, unique);
+}
+
+// Merges count runs of list, starting at first, into out without repeats and
+// without the boards that the exclude readers (sorted, or NULL) hold. Sets
+// *found when goal is written. Returns 0 on an I/O error.
+static int merge_runs(ExternalSearch *search, const RunList *list, int first, int count, BoardReader *exclude[2],
+                      BoardWriter *out, board_t goal, int *found)
+{
+    BoardReader readers[EXTERNAL_MERGE_WAY];
+    board_t heads[EXTERNAL_MERGE_WAY];
+    int live = 0;
+    for (int i = 0; i < count; i++)
+    {
+        const Run *run = &list->runs[first + i];
+        open_reader(&readers[live], list->fd, run->offset, run->count,
+                    search->memory + (3 + i) * search->block_boards, search->block_boards);
+        int status = peek_board(&readers[live], &heads[live]);
+        if (status < 0)
+            return 0;
+        live += status;
+    }
+
+    int written = 0;
+    board_t last = 0;
+    while (live > 0)
+    {
+        // The fan-in is small enough that a scan finds the smallest head as
+        // fast as a heap would
+        int smallest = 0;
+        for (int i = 1; i < live; i++)
+        {
+            if (heads[i] < heads[smallest])
+                smallest = i;
+        }
+        board_t board = heads[smallest];
+        readers[smallest].next++;
+        int status = peek_board(&readers[smallest], &heads[smallest]);
+        if (status < 0)
+            return 0;
+        if (status == 0)
+        {
+            live--;
+            readers[smallest] = readers[live];
+            heads[smallest] = heads[live];
+        }
+
+        int seen = written && board == last;
+        for (int e = 0; e < 2 && !seen && exclude != NULL; e++)
+        {
+            if (exclude[e] != NULL && (seen = skip_to_board(exclude[e], board)) < 0)
+                return 0;
+        }
+        if (seen)
+        {
+            search->stats->duplicates++;
+            continue;
+        }
+        if (!write_board(out, board))
+            return 0;
+        written = 1;
+        last = board;
+        if (board == goal)
+            *found = 1;
+    }
+    return 1;
+}
+
+static int push_external_layer(ExternalSearch *search, int fd, uint64_t count)
+{
+    if (search->layer_count == search->layer_capacity)
+    {
+        int capacity = search->layer_capacity ? 2 * search->layer_capacity : 64;
+        ExternalLayer *layers = (ExternalLayer *)realloc(search->layers, capacity * sizeof(ExternalLayer));
+        if (layers == NULL)
+        {
+            perror("Failed to allocate memory for search layers");
+            return 0;
+        }
+        search->layers = layers;
+        search->layer_capacity = capacity;
+    }
+    search->layers[search->layer_count].fd = fd;
+    search->layers[search->layer_count].count = count;
+    search->layer_count++;
+    return 1;
+}
+
+// Appends the layer one move beyond the last one. Sets *found when it holds
+// goal. Returns 0 on an I/O error.
+static int advance_external_layer(ExternalSearch *search, const int neighbors[NUM_POSITIONS][4], board_t goal,
+                                  int *found)
+{
+    SearchStats *stats = search->stats;
+    size_t block = search->block_boards;
+    RunList *from = &search->runs[0], *to = &search->runs[1];
+    from->count = 0;
+    from->end = 0;
+
+    // The last layer streams through the first block, and its children fill
+    // the rest of the cap before each sort
+    const ExternalLayer *current = &search->layers[search->layer_count - 1];
+    BoardReader reader;
+    open_reader(&reader, current->fd, 0, current->count, search->memory, block);
+    board_t *buffer = search->memory + block;
+    size_t buffer_boards = search->memory_boards - block;
+    size_t buffered = 0;
+    board_t children[MAX_CHILDREN];
+    int child_moves[MAX_CHILDREN];
+    board_t board;
+    int status;
+    while ((status = peek_board(&reader, &board)) == 1)
+    {
+        reader.next++;
+        stats->expanded++;
+        int count = generate_children(board, neighbors, children, child_moves);
+        stats->generated += count;
+        if (buffered + count > buffer_boards)
+        {
+            if (!write_run(from, buffer, buffered, stats))
+                return 0;
+            buffered = 0;
+        }
+        memcpy(buffer + buffered, children, count * sizeof(board_t));
+        buffered += count;
+    }
+    if (status < 0 || (buffered > 0 && !write_run(from, buffer, buffered, stats)))
+        return 0;
+
+    // Merge in groups until one pass takes every run
+    BoardWriter writer;
+    while (from->count > EXTERNAL_MERGE_WAY)
+    {
+        to->count = 0;
+        to->end = 0;
+        for (int first = 0; first < from->count; first += EXTERNAL_MERGE_WAY)
+        {
+            int count = from->count - first < EXTERNAL_MERGE_WAY ? from->count - first : EXTERNAL_MERGE_WAY;
+            open_writer(&writer, to->fd, to->end, search->memory + 2 * block, block, stats);
+            int unused = 0;
+            if (!merge_runs(search, from, first, count, NULL, &writer, goal, &unused) || !flush_writer(&writer) ||
+                !push_run(to, to->end, writer.written))
+                return 0;
+        }
+        RunList swap = *from;
+        *from = *to;
+        *to = swap;
+    }
+
+    // The last pass drops the boards of the previous and current layers
+    BoardReader layer_readers[2];
+    BoardReader *exclude[2] = {NULL, NULL};
+    for (int i = 0; i < 2 && i < search->layer_count; i++)
+    {
+        const ExternalLayer *layer = &search->layers[search->layer_count - 1 - i];
+        open_reader(&layer_readers[i], layer->fd, 0, layer->count, search->memory + i * block, block);
+        exclude[i] = &layer_readers[i];
+    }
+    int fd = open_scratch_file(search->scratch_dir);
+    if (fd < 0)
+        return 0;
+    open_writer(&writer, fd, 0, search->memory + 2 * block, block, stats);
+    if (!merge_runs(search, from, 0, from->count, exclude, &writer, goal, found) || !flush_writer(&writer) ||
+        !push_external_layer(search, fd, writer.written))
+    {
+        close(fd);
+        return 0;
+    }
+    return 1;
+}
+
+// Returns 1 when a layer file holds board, 0 when not and -1 on a read error
+static int external_layer_contains(const ExternalLayer *layer, board_t board)
+{
+    uint64_t low = 0, high = layer->count;
+    while (low < high)
+    {
+        uint64_t mid = low + (high - low) / 2;
+        board_t value;
+        if (pread(layer->fd, &value, sizeof(value), (off_t)(mid * sizeof(board_t))) != sizeof(value))
+        {
+            perror("Failed to read scratch file");
+            return -1;
+        }
+        if (value < board)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    if (low == layer->count)
+        return 0;
+    board_t value;
+    if (pread(layer->fd, &value, sizeof(value), (off_t)(low * sizeof(board_t))) != sizeof(value))
+    {
+        perror("Failed to read scratch file");
+        return -1;
+    }
+    return value == board;
+}
+
+// Writes the moves from the root to goal, which is in the last layer, by
+// stepping back to a neighbour in each layer before it
+static int trace_external_path(const ExternalSearch *search, board_t goal, const int neighbors[NUM_POSITIONS][4],
+                               int moves[])
+{
+    board_t children[MAX_CHILDREN];
+    int child_moves[MAX_CHILDREN];
+    board_t board = goal;
+    for (int depth = search->layer_count - 1; depth > 0; depth--)
+    {
+        int count = generate_children(board, neighbors, children, child_moves);
+        int i = 0, status = 0;
+        while (i < count && (status = external_layer_contains(&search->layers[depth - 1], children[i])) == 0)
+            i++;
+        if (status <= 0)
+            return status;
+        moves[depth - 1] = reverse_move(child_moves[i]);
+        board = children[i];
+    }
+    return 1;
+}
+
+static void free_external_search(ExternalSearch *search)
+{
+    for (int i = 0; i < search->layer_count; i++)
+        close(search->layers[i].fd);
+    for (int i = 0; i < 2; i++)
+    {
+        if (search->runs[i].fd >= 0)
+            close(search->runs[i].fd);
+        free(search->runs[i].runs);
+    }
+    free(search->layers);
+    free(search->memory);
+}
+
+// Searches from root until a layer holds goal. Returns 1 then, 0 when the
+// boards run out first and -1 on an I/O error.
+static int run_external_layers(ExternalSearch *search, board_t root, board_t goal,
+                               const int neighbors[NUM_POSITIONS][4])
+{
+    int fd = open_scratch_file(search->scratch_dir);
+    if (fd < 0)
+        return -1;
+    if (!write_boards(fd, &root, 1, 0, search->stats) || !push_external_layer(search, fd, 1))
+    {
+        close(fd);
+        return -1;
+    }
+    note_frontier(search->stats, 0, 1);
+
+    int reached = root == goal;
+    while (!reached)
+    {
+        if (!advance_external_layer(search, neighbors, goal, &reached))
+            return -1;
+        uint64_t count = search->layers[search->layer_count - 1].count;
+        if (count == 0)
+            return 0;
+        note_frontier(search->stats, search->layer_count - 1, count);
+        note_queue_size(search->stats, count);
+    }
+    return 1;
+}
+
+// memory is the cap in bytes on what the search holds, scratch_dir where its
+// files go. moves grows when the path is longer than *moves_capacity.
+static int solve_external(board_t board_start, board_t board_goal, const int neighbors[NUM_POSITIONS][4],
+                          size_t memory, const char *scratch_dir, int **moves, uint32_t *moves_capacity,
+                          int *move_count, SearchStats *stats)
+{
+    ExternalSearch search;
+    memset(&search, 0, sizeof(search));
+    search.runs[0].fd = search.runs[1].fd = -1;
+    search.scratch_dir = scratch_dir;
+    search.stats = stats;
+    *move_count = 0;
+
+    // solver_set_external keeps memory at EXTERNAL_BLOCKS * EXTERNAL_BLOCK_MIN or more
+    size_t block = memory / EXTERNAL_BLOCKS;
+    block = block > EXTERNAL_BLOCK_MAX ? EXTERNAL_BLOCK_MAX : block;
+    search.block_boards = block / sizeof(board_t);
+    search.memory_boards = memory / sizeof(board_t);
+    search.memory = (board_t *)malloc(search.memory_boards * sizeof(board_t));
+    if (search.memory == NULL)
+    {
+        perror("Failed to allocate memory for external search");
+        return -1;
+    }
+
+    int found = -1;
+    if ((search.runs[0].fd = open_scratch_file(scratch_dir)) >= 0 &&
+        (search.runs[1].fd = open_scratch_file(scratch_dir)) >= 0)
+        found = run_external_layers(&search, board_start, board_goal, neighbors);
+    if (found == 1)
+    {
+        double reconstruct_start = monotonic_ms();
+        uint32_t distance = search.layer_count - 1;
+        if (distance > *moves_capacity)
+        {
+            int *grown = (int *)realloc(*moves, distance * sizeof(int));
+            if (grown == NULL)
+            {
+                perror("Failed to allocate memory for path");
+                found = -1;
+            }
+            else
+            {
+                *moves = grown;
+                *moves_capacity = distance;
+            }
+        }
+        // Every board of a layer has a neighbour in the layer before, so
+        // only a read error stops the walk
+        if (found == 1 && trace_external_path(&search, board_goal, neighbors, *moves) != 1)
+            found = -1;
+        if (found == 1)
+            *move_count = distance;
+        stats->reconstruct_ms += monotonic_ms() - reconstruct_start;
+    }
+
+    free_external_search(&search);
+    return found;
+}
+#pragma endregion
+
+#pragma region Depth Mod 3 Search
+// Every neighbour of a board at depth d sits at depth d - 1, d or d + 1, and
+// those differ modulo 3. So two bits per ranked state (0 while unseen, then
+// depth mod 3 plus one) are enough to walk back from the goal: some
+// neighbour always holds the code for depth d - 1. That is 63 KB for the
+// largest piece counts instead of 12 bytes per expanded state, and there is
+// no cap on how many states the search expands.
+static inline int get_depth_code(const uint8_t *codes, uint32_t rank)
+{
+    return (codes[rank >> 2] >> ((rank & 3) * 2)) & 0b11;
+}
+
+static inline void set_depth_code(uint8_t *codes, uint32_t rank, int code)
+{
+    codes[rank >> 2] |= code << ((rank & 3) * 2); // Codes are only ever set from 0
+}
+
+static int solve_mod3(board_t board_start, board_t board_goal, const int neighbors[NUM_POSITIONS][4],
+                      int whites, int blacks, int moves[], int *move_count, SearchStats *stats)
+{
+    uint32_t size = count_states(whites, blacks);
+    uint8_t *codes = (uint8_t *)calloc((size + 3) / 4, 1);
+    if (codes == NULL)
+    {
+        perror("Failed to allocate memory for depth codes");
+        return -1;
+    }
+    Layer frontier = {NULL, 0, 0}, next = {NULL, 0, 0};
+    board_t children[MAX_CHILDREN];
+    int child_moves[MAX_CHILDREN];
+
+    int found = board_start == board_goal;
+    int failed = !push_layer(&frontier, board_start);
+    set_depth_code(codes, rank_board(board_start), 1);
+    int depth = 0;
+    note_frontier(stats, depth, 1);
+    while (!found && !failed && frontier.count > 0)
+    {
+        int code = (depth + 1) % 3 + 1;
+        next.count = 0;
+        for (uint32_t b = 0; b < frontier.count && !found && !failed; b++)
+        {
+            int count = generate_children(frontier.boards[b], neighbors, children, child_moves);
+            stats->expanded++;
+            stats->generated += count;
+            for (int i = 0; i < count; i++)
+            {
+                uint32_t rank = rank_board(children[i]);
+                if (get_depth_code(codes, rank) != 0)
+                {
+                    stats->duplicates++;
+                    continue;
+                }
+                set_depth_code(codes, rank, code);
+                if (children[i] == board_goal)
+                {
+                    found = 1;
+                    break;
+                }
+                if (!push_layer(&next, children[i]))
+                {
+                    failed = 1;
+                    break;
+                }
+            }
+        }
+        Layer swap = frontier;
+        frontier = next;
+        next = swap;
+        depth++;
+        note_frontier(stats, depth, frontier.count + found);
+        note_queue_size(stats, frontier.count);
+    }
+
+    *move_count = 0;
+    if (found && !failed)
+    {
+        double reconstruct_start = monotonic_ms();
+        // Step back to a neighbour one layer closer, filling moves from the end
+        board_t board = board_goal;
+        *move_count = depth;
+        for (int d = depth; d > 0; d--)
+        {
+            int previous = (d - 1) % 3 + 1;
+            int count = generate_children(board, neighbors, children, child_moves);
+            for (int i = 0; i < count; i++)
+            {
+                if (get_depth_code(codes, rank_board(children[i])) == previous)
+                {
+                    board = children[i];
+                    moves[d - 1] = reverse_move(child_moves[i]);
+                    break;
+                }
+            }
+        }
+        stats->reconstruct_ms += monotonic_ms() - reconstruct_start;
+    }
+
+    free(frontier.boards);
+    free(next.boards);
+    free(codes);
+    return failed ? -1 : found;
+}
+#pragma endregion
+
+#pragma region Shortest Path Counting
+// A breadth-first search back from the goal gives each board its distance to
+// the goal and, as a sum over the boards one move closer, how many shortest
+// paths lead from it to the goal. Shortest paths from the start are then the
+// walks that lower the distance by one at every move, taken in move
+// generation order: the k-th one is found by skipping whole subtrees by
+// their counts, and all of them can be streamed depth-first with a stack as
+// deep as the path, so none are held in memory.
+#define PATH_UNSEEN 0xFFFF
+#define PATH_COUNT_SATURATED UINT64_MAX
+
+typedef struct PathCounts
+{
+    uint16_t *distances; // Moves to the goal per ranked state, PATH_UNSEEN if not reached
+    uint64_t *counts;    // Shortest paths to the goal per ranked state, saturating
+    int distance;        // Of the start, -1 when the goal cannot be reached
+} PathCounts;
+
+static inline uint64_t add_path_counts(uint64_t a, uint64_t b)
+{
+    return a > PATH_COUNT_SATURATED - b ? PATH_COUNT_SATURATED : a + b;
+}
+
+// Returns 1 when the goal is reachable, 0 when it is not and -1 on
+// allocation failure
+static int count_paths(PathCounts *paths, board_t board_start, board_t board_goal,
+                       const int neighbors[NUM_POSITIONS][4], int whites, int blacks)
+{
+    uint32_t size = count_states(whites, blacks);
+    paths->distances = (uint16_t *)malloc(size * sizeof(uint16_t));
+    paths->counts = (uint64_t *)calloc(size, sizeof(uint64_t));
+    board_t *queue = (board_t *)malloc(size * sizeof(board_t));
+    if (paths->distances == NULL || paths->counts == NULL || queue == NULL)
+    {
+        perror("Failed to allocate memory for path counts");
+        free(queue);
+        return -1;
+    }
+    memset(paths->distances, 0xFF, size * sizeof(uint16_t));
+
+    board_t children[MAX_CHILDREN];
+    int child_moves[MAX_CHILDREN];
+    uint32_t head = 0, tail = 0;
+    uint32_t rank = rank_board(board_goal);
+    uint32_t start_rank = rank_board(board_start);
+    paths->distances[rank] = 0;
+    paths->counts[rank] = 1;
+    queue[tail++] = board_goal;
+    while (head < tail)
+    {
+        board_t board = queue[head++];
+        uint32_t board_rank = rank_board(board);
+        int distance = paths->distances[board_rank];
+        // The start's count is complete once the layer before it is done
+        if (paths->distances[start_rank] != PATH_UNSEEN && distance >= paths->distances[start_rank])
+            break;
+
+        int count = generate_children(board, neighbors, children, child_moves);
+        for (int i = 0; i < count; i++)
+        {
+            rank = rank_board(children[i]);
+            if (paths->distances[rank] == PATH_UNSEEN)
+            {
+                paths->distances[rank] = distance + 1;
+                queue[tail++] = children[i];
+            }
+            if (paths->distances[rank] == distance + 1)
+                paths->counts[rank] = add_path_counts(paths->counts[rank], paths->counts[board_rank]);
+        }
+    }
+    free(queue);
+
+    paths->distance = paths->distances[start_rank] == PATH_UNSEEN ? -1 : paths->distances[start_rank];
+    return paths->distance >= 0;
+}
+
+static void free_path_counts(PathCounts *paths)
+{
+    free(paths->distances);
+    free(paths->counts);
+    paths->distances = NULL;
+    paths->counts = NULL;
+}
+
+// Writes the k-th shortest path (from 0) into moves. Returns 0 when there are
+// no more than k paths, and -1 when the count saturated so k cannot be placed.
+static int kth_path(const PathCounts *paths, board_t board_start, const int neighbors[NUM_POSITIONS][4],
+                    uint64_t k, int moves[])
+{
+    uint64_t total = paths->counts[rank_board(board_start)];
+    if (total == PATH_COUNT_SATURATED)
+        return -1;
+    if (k >= total)
+        return 0;
+
+    board_t children[MAX_CHILDREN];
+    int child_moves[MAX_CHILDREN];
+    board_t board = board_start;
+    for (int level = 0; level < paths->distance; level++)
+    {
+        int count = generate_children(board, neighbors, children, child_moves);
+        for (int i = 0; i < count; i++)
+        {
+            uint32_t rank = rank_board(children[i]);
+            if (paths->distances[rank] != paths->distance - level - 1)
+                continue;
+            if (k < paths->counts[rank])
+            {
+                board = children[i];
+                moves[level] = child_moves[i];
+                break;
+            }
+            k -= paths->counts[rank];
+        }
+    }
+    return 1;
+}
+
+typedef struct PathIterator
+{
+    const PathCounts *paths;
+    const int (*neighbors)[4];
+    board_t *boards; // Board at each level of the current path
+    int *next_child;  // Child of that board to try next
+    int level;
+    int done;
+} PathIterator;
+
+static int init_path_iterator(PathIterator *iterator, const PathCounts *paths, board_t board_start,
+                              const int neighbors[NUM_POSITIONS][4])
+{
+    iterator->paths = paths;
+    iterator->neighbors = neighbors;
+    iterator->boards = (board_t *)malloc((paths->distance + 1) * sizeof(board_t));
+    iterator->next_child = (int *)calloc(paths->distance + 1, sizeof(int));
+    if (iterator->boards == NULL || iterator->next_child == NULL)
+    {
+        perror("Failed to allocate memory for path iterator");
+        free(iterator->boards);
+        free(iterator->next_child);
+        return 0;
+    }
+    iterator->boards[0] = board_start;
+    iterator->level = 0;
+    iterator->done = 0;
+    return 1;
+}
+
+// Writes the next shortest path into moves, in the order kth_path counts
+// them. Returns 0 once every path has been produced.
+static int next_path(PathIterator *iterator, int moves[])
+{
+    const PathCounts *paths = iterator->paths;
+    board_t children[MAX_CHILDREN];
+    int child_moves[MAX_CHILDREN];
+    if (iterator->done)
+        return 0;
+    if (paths->distance == 0)
+    {
+        iterator->done = 1;
+        return 1;
+    }
+    if (iterator->level == paths->distance)
+        iterator->level--; // Resume below the path returned last time
+
+    while (iterator->level >= 0)
+    {
+        int level = iterator->level;
+        int count = generate_children(iterator->boards[level], iterator->neighbors, children, child_moves);
+        int i = iterator->next_child[level];
+        while (i < count && paths->distances[rank_board(children[i])] != paths->distance - level - 1)
+            i++;
+        if (i == count)
+        {
+            iterator->level--;
+            continue;
+        }
+        iterator->next_child[level] = i + 1;
+        moves[level] = child_moves[i];
+        iterator->boards[level + 1] = children[i];
+        iterator->level++;
+        if (iterator->level == paths->distance)
+            return 1;
+        iterator->next_child[iterator->level] = 0;
+    }
+    iterator->done = 1;
+    return 0;
+}
+
+static void free_path_iterator(PathIterator *iterator)
+{
+    free(iterator->boards);
+    free(iterator->next_child);
+    iterator->boards = NULL;
+    iterator->next_child = NULL;
+}
+
+
+#pragma endregion
+
+#pragma region Heuristic Search
+// Every move shifts one piece along one edge, so the cheapest way to match
+// the pieces of each colour to that colour's goal cells (by graph distance)
+// is an admissible and consistent lower bound on the remaining moves. Loaded
+// pattern databases (see pattern_db.h) are exact for a relaxed goal, so the
+// estimate is the largest of these bounds.
+#define DEAD_END -1
+
+typedef struct Heuristic
+{
+    const int (*distances)[NUM_POSITIONS];
+    int goal_cells[2][NUM_POSITIONS]; // White then black goal cells
+    int goal_counts[2];
+    const PatternDb *pattern_dbs; // Indexed by pattern colour; unloaded ones have no header
+} Heuristic;
+
+static void init_distances(const int neighbors[NUM_POSITIONS][4], int distances[NUM_POSITIONS][NUM_POSITIONS])
+{
+    for (int source = 0; source < NUM_POSITIONS; source++)
+    {
+        int queue[NUM_POSITIONS];
+        int head = 0, tail = 0;
+        for (int i = 0; i < NUM_POSITIONS; i++)
+            distances[source][i] = -1;
+        distances[source][source] = 0;
+        queue[tail++] = source;
+        while (head < tail)
+        {
+            int cell = queue[head++];
+            for (int j = 0; j < 4 && neighbors[cell][j] != -1; j++)
+            {
+                int next = neighbors[cell][j];
+                if (distances[source][next] == -1)
+                {
+                    distances[source][next] = distances[source][cell] + 1;
+                    queue[tail++] = next;
+                }
+            }
+        }
+    }
+}
+
+static void init_heuristic(Heuristic *heuristic, board_t board_goal, const int distances[NUM_POSITIONS][NUM_POSITIONS],
+                           const PatternDb pattern_dbs[2])
+{
+    heuristic->distances = distances;
+    heuristic->pattern_dbs = pattern_dbs;
+    heuristic->goal_counts[0] = heuristic->goal_counts[1] = 0;
+    for (int i = 0; i < NUM_POSITIONS; i++)
+    {
+        uint32_t val = (board_goal >> (2 * (NUM_POSITIONS - 1 - i))) & 0b11;
+        if (val & 0b01)
+        {
+            int colour = (val >> 1) & 1;
+            heuristic->goal_cells[colour][heuristic->goal_counts[colour]++] = i;
+        }
+    }
+}
+
+// Hungarian algorithm on the n x n matrix of distances from the piece cells
+// to the goal cells; returns the cost of the cheapest perfect matching
+static int min_cost_assignment(const int pieces[], const int goals[], int n, const int distances[NUM_POSITIONS][NUM_POSITIONS])
+{
+    int u[NUM_POSITIONS + 1] = {0}, v[NUM_POSITIONS + 1] = {0};
+    int match[NUM_POSITIONS + 1] = {0}, way[NUM_POSITIONS + 1];
+    for (int row = 1; row <= n; row++)
+    {
+        int min_slack[NUM_POSITIONS + 1];
+        int used[NUM_POSITIONS + 1] = {0};
+        for (int j = 0; j <= n; j++)
+            min_slack[j] = 1 << 30;
+        match[0] = row;
+        int col = 0;
+        do
+        {
+            used[col] = 1;
+            int i = match[col], delta = 1 << 30, next = 0;
+            for (int j = 1; j <= n; j++)
+            {
+                if (used[j])
+                    continue;
+                int slack = distances[pieces[i - 1]][goals[j - 1]] - u[i] - v[j];
+                if (slack < min_slack[j])
+                {
+                    min_slack[j] = slack;
+                    way[j] = col;
+                }
+                if (min_slack[j] < delta)
+                {
+                    delta = min_slack[j];
+                    next = j;
+                }
+            }
+            for (int j = 0; j <= n; j++)
+            {
+                if (used[j])
+                {
+                    u[match[j]] += delta;
+                    v[j] -= delta;
+                }
+                else
+                {
+                    min_slack[j] -= delta;
+                }
+            }
+            col = next;
+        } while (match[col] != 0);
+        do
+        {
+            int prev = way[col];
+            match[col] = match[prev];
+            col = prev;
+        } while (col != 0);
+    }
+    return -v[0];
+}
+
+static int estimate_moves(const Heuristic *heuristic, board_t board)
+{
+    int cells[2][NUM_POSITIONS];
+    int counts[2] = {0, 0};
+    for (int i = 0; i < NUM_POSITIONS; i++)
+    {
+        uint32_t val = (board >> (2 * (NUM_POSITIONS - 1 - i))) & 0b11;
+        if (val & 0b01)
+        {
+            int colour = (val >> 1) & 1;
+            cells[colour][counts[colour]++] = i;
+        }
+    }
+    int estimate = min_cost_assignment(cells[0], heuristic->goal_cells[0], counts[0], heuristic->distances) +
+                   min_cost_assignment(cells[1], heuristic->goal_cells[1], counts[1], heuristic->distances);
+
+    if (heuristic->pattern_dbs != NULL)
+    {
+        uint32_t rank = rank_board(board);
+        for (int pattern = PDB_PATTERN_WHITE; pattern <= PDB_PATTERN_BLACK; pattern++)
+        {
+            const PatternDb *pdb = &heuristic->pattern_dbs[pattern];
+            if (pdb->header == NULL)
+                continue;
+            int distance = pdb->distances[rank];
+            if (distance == PDB_UNREACHABLE)
+                return DEAD_END; // Not even the relaxed goal can be reached
+            if (distance > estimate)
+                estimate = distance;
+        }
+    }
+    return estimate;
+}
+
+// Open list for A*: one LIFO stack of boards per f value. f never decreases
+// with a consistent heuristic, so the lowest non-empty bucket only moves up.
+typedef struct Bucket
+{
+    board_t *boards;
+    uint32_t size;
+    uint32_t capacity;
+} Bucket;
+
+typedef struct OpenList
+{
+    Bucket *buckets;
+    int count;
+    int lowest;
+} OpenList;
+
+static int push_open(OpenList *open, int f, board_t board)
+{
+    if (f >= open->count)
+    {
+        int count = open->count ? open->count : 64;
+        while (count <= f)
+            count *= 2;
+        Bucket *buckets = (Bucket *)realloc(open->buckets, count * sizeof(Bucket));
+        if (buckets == NULL)
+        {
+            perror("Failed to allocate memory for open list");
+            return 0;
+        }
+        memset(buckets + open->count, 0, (count - open->count) * sizeof(Bucket));
+        open->buckets = buckets;
+        open->count = count;
+    }
+    Bucket *bucket = &open->buckets[f];
+    if (bucket->size == bucket->capacity)
+    {
+        uint32_t capacity = bucket->capacity ? 2 * bucket->capacity : 256;
+        board_t *boards = (board_t *)realloc(bucket->boards, capacity * sizeof(board_t));
+        if (boards == NULL)
+        {
+            perror("Failed to allocate memory for open list");
+            return 0;
+        }
+        bucket->boards = boards;
+        bucket->capacity = capacity;
+    }
+    bucket->boards[bucket->size++] = board;
+    if (f < open->lowest)
+        open->lowest = f;
+    return 1;
+}
+
+static int pop_open(OpenList *open, board_t *board)
+{
+    while (open->lowest < open->count && open->buckets[open->lowest].size == 0)
+        open->lowest++;
+    if (open->lowest >= open->count)
+        return 0;
+    Bucket *bucket = &open->buckets[open->lowest];
+    *board = bucket->boards[--bucket->size];
+    return 1;
+}
+
+static void free_open(OpenList *open)
+{
+    for (int i = 0; i < open->count; i++)
+        free(open->buckets[i].boards);
+    free(open->buckets);
+    open->buckets = NULL;
+    open->count = 0;
+}
+
+#define COST_UNSEEN 0xFFFF
+
+static int solve_astar(board_t board_start, board_t board_goal, const int neighbors[NUM_POSITIONS][4],
+                       const int distances[NUM_POSITIONS][NUM_POSITIONS], const PatternDb pattern_dbs[2],
+                       int whites, int blacks, int moves[], int *move_count, SearchStats *stats)
+{
+    uint32_t size = count_states(whites, blacks);
+    Heuristic heuristic;
+    init_heuristic(&heuristic, board_goal, distances, pattern_dbs);
+
+    uint16_t *cost = (uint16_t *)malloc(size * sizeof(uint16_t));
+    move_t *reached_by = (move_t *)malloc(size * sizeof(move_t));
+    VisitedSet closed;
+    OpenList open = {NULL, 0, 0};
+    if (cost == NULL || reached_by == NULL || !init_visited_set(&closed, whites, blacks))
+    {
+        perror("Failed to allocate memory for A* tables");
+        free(cost);
+        free(reached_by);
+        return -1;
+    }
+    memset(cost, 0xFF, size * sizeof(uint16_t));
+
+    uint32_t start_rank = rank_board(board_start);
+    cost[start_rank] = 0;
+    reached_by[start_rank] = MOVE_ROOT;
+    int estimate = estimate_moves(&heuristic, board_start);
+    int found = (estimate == DEAD_END || push_open(&open, estimate, board_start)) ? 0 : -1;
+    unsigned long open_size = found == 0 && estimate != DEAD_END;
+
+    board_t board;
+    board_t children[MAX_CHILDREN];
+    int child_moves[MAX_CHILDREN];
+    while (found == 0 && pop_open(&open, &board))
+    {
+        // Boards can sit in the open list more than once; expand each only once
+        open_size--;
+        if (test_and_set_visited(&closed, board))
+            continue;
+        if (board == board_goal)
+        {
+            found = 1;
+            break;
+        }
+
+        int g = cost[rank_board(board)] + 1;
+        int count = generate_children(board, neighbors, children, child_moves);
+        stats->expanded++;
+        stats->generated += count;
+        for (int i = 0; i < count; i++)
+        {
+            uint32_t rank = rank_board(children[i]);
+            if (cost[rank] != COST_UNSEEN && cost[rank] <= g)
+            {
+                stats->duplicates++;
+                continue;
+            }
+            estimate = estimate_moves(&heuristic, children[i]);
+            if (estimate == DEAD_END)
+                continue;
+            cost[rank] = g;
+            reached_by[rank] = child_moves[i];
+            if (!push_open(&open, g + estimate, children[i]))
+            {
+                found = -1;
+                break;
+            }
+            open_size++;
+        }
+        note_queue_size(stats, open_size);
+    }
+
+    *move_count = 0;
+    if (found == 1)
+        trace_moves(reached_by, board_goal, moves, move_count, stats);
+
+    stats->probes += closed.probes;
+    free_open(&open);
+    free_visited_set(&closed);
+    free(cost);
+    free(reached_by);
+    return found;
+}
+
+// IDA* keeps only the current path plus a direct-mapped transposition cache
+// indexed by rank, which prunes boards already reached at no greater depth
+// within the same iteration. The cache is capped, so on large state spaces it
+// degrades to a lossy cache instead of growing with the search.
+#define TRANSPOSITION_MAX_BITS 20
+
+typedef struct Transposition
+{
+    board_t board;
+    uint16_t depth;
+    uint16_t iteration;
+} Transposition;
+
+typedef struct DepthFirstSearch
+{
+    const int (*neighbors)[4];
+    Heuristic heuristic;
+    board_t board_goal;
+    Transposition *transpositions;
+    uint32_t transposition_mask;
+    uint16_t iteration;
+    uint32_t expanded; // Distinct boards expanded in this iteration
+    int bound;
+    int next_bound;
+    int *moves;
+    SearchStats *stats;
+} DepthFirstSearch;
+
+static int depth_first_search(DepthFirstSearch *search, board_t board, int depth, int last_move)
+{
+    int estimate = estimate_moves(&search->heuristic, board);
+    if (estimate == DEAD_END)
+        return 0;
+    int f = depth + estimate;
+    if (f > search->bound)
+    {
+        if (f < search->next_bound)
+            search->next_bound = f;
+        return 0;
+    }
+    if (board == search->board_goal)
+        return 1;
+
+    Transposition *entry = &search->transpositions[rank_board(board) & search->transposition_mask];
+    if (entry->board == board && entry->iteration == search->iteration)
+    {
+        if (entry->depth <= depth)
+        {
+            search->stats->duplicates++;
+            return 0;
+        }
+    }
+    else
+    {
+        search->expanded++;
+    }
+    entry->board = board;
+    entry->depth = depth;
+    entry->iteration = search->iteration;
+
+    board_t children[MAX_CHILDREN];
+    int child_moves[MAX_CHILDREN];
+    int count = generate_children(board, search->neighbors, children, child_moves);
+    search->stats->expanded++;
+    search->stats->generated += count;
+    int undo = last_move == MOVE_ROOT ? -1 : reverse_move(last_move);
+    for (int i = 0; i < count; i++)
+    {
+        if (child_moves[i] == undo)
+            continue; // Never step straight back
+        search->moves[depth] = child_moves[i];
+        if (depth_first_search(search, children[i], depth + 1, child_moves[i]))
+            return 1;
+    }
+    return 0;
+}
+
+// Starts from lower_bound when that beats the heuristic (see check_puzzle)
+static int solve_idastar(board_t board_start, board_t board_goal, const int neighbors[NUM_POSITIONS][4],
+                         const int distances[NUM_POSITIONS][NUM_POSITIONS], const PatternDb pattern_dbs[2],
+                         int whites, int blacks, int lower_bound, int moves[], int *move_count, SearchStats *stats)
+{
+    uint32_t size = count_states(whites, blacks);
+    DepthFirstSearch search;
+    search.neighbors = neighbors;
+    init_heuristic(&search.heuristic, board_goal, distances, pattern_dbs);
+    search.board_goal = board_goal;
+    uint32_t entries = 1;
+    while (entries < size && entries < (1u << TRANSPOSITION_MAX_BITS))
+        entries *= 2;
+    search.transposition_mask = entries - 1;
+    search.transpositions = (Transposition *)calloc(entries, sizeof(Transposition));
+    if (search.transpositions == NULL)
+    {
+        perror("Failed to allocate memory for transposition cache");
+        return -1;
+    }
+    search.iteration = 0;
+    search.moves = moves;
+    search.stats = stats;
+    search.bound = estimate_moves(&search.heuristic, board_start);
+    *move_count = 0;
+    if (search.bound == DEAD_END)
+    {
+        free(search.transpositions);
+        return 0;
+    }
+    if (lower_bound > search.bound)
+        search.bound = lower_bound;
+
+    // With an exact cache, if raising the bound by two or more adds no new
+    // board, every neighbour of an expanded board is within the bound too:
+    // the reachable states are exhausted and the goal is not among them.
+    int exact = entries >= size;
+    uint32_t last_expanded = 0;
+    int last_growth_bound = search.bound;
+
+    int found = 0;
+    *move_count = 0;
+    while ((uint32_t)search.bound <= size)
+    {
+        search.next_bound = 1 << 30;
+        search.expanded = 0;
+        if (++search.iteration == 0)
+        {
+            // Tags wrapped around; stale entries must not match again
+            memset(search.transpositions, 0, entries * sizeof(Transposition));
+            search.iteration = 1;
+        }
+        if (depth_first_search(&search, board_start, 0, MOVE_ROOT))
+        {
+            *move_count = search.bound;
+            found = 1;
+            break;
+        }
+        if (search.next_bound == 1 << 30)
+            break; // Nothing left beyond this bound
+        if (search.expanded != last_expanded)
+        {
+            last_expanded = search.expanded;
+            last_growth_bound = search.bound;
+        }
+        else if (exact && search.bound >= last_growth_bound + 2)
+        {
+            break;
+        }
+        search.bound = search.next_bound;
+    }
+
+    free(search.transpositions);
+    return found;
+}
+#pragma endregion
+
+#pragma region Solvability Oracle
+// Cheap checks run before any search. On a pendant arm (the cells from a
+// leaf up to the first junction) pieces keep their order, since they can only
+// get past each other at the junction. For the i-th piece from the leaf to
+// step onto the junction, every piece above it must have left the arm while
+// the pieces below it stayed inside, which needs room for them elsewhere:
+// with E empty cells, the bottom L - E pieces of an arm of L cells can never
+// leave. Those pieces, and their colours in order, must be the same at the
+// start and at the goal. A graph with no junction is one long arm in which
+// no piece ever passes another.
+//
+// The graph is a tree, so its cells split into two classes with every edge
+// between them, and each move changes by one how many pieces stand on the
+// first class. The length of any solution therefore has the parity of the
+// difference between start and goal, which can raise the matching bound by
+// one.
+#define ORACLE_UNSOLVABLE -1
+
+typedef struct Arm
+{
+    int cells[NUM_POSITIONS]; // From the leaf up, without the junction
+    int length;
+    int has_junction;
+} Arm;
+
+static int find_arms(const int neighbors[NUM_POSITIONS][4], Arm arms[])
+{
+    int degree[NUM_POSITIONS];
+    for (int i = 0; i < NUM_POSITIONS; i++)
+    {
+        degree[i] = 0;
+        while (degree[i] < 4 && neighbors[i][degree[i]] != -1)
+            degree[i]++;
+    }
+
+    int arm_count = 0;
+    for (int leaf = 0; leaf < NUM_POSITIONS; leaf++)
+    {
+        if (degree[leaf] > 1)
+            continue;
+        Arm *arm = &arms[arm_count++];
+        arm->length = 0;
+        arm->has_junction = 0;
+        int previous = -1, cell = leaf;
+        while (cell != -1)
+        {
+            if (degree[cell] > 2)
+            {
+                arm->has_junction = 1;
+                break;
+            }
+            arm->cells[arm->length++] = cell;
+            int next = -1;
+            for (int j = 0; j < degree[cell]; j++)
+            {
+                if (neighbors[cell][j] != previous)
+                    next = neighbors[cell][j];
+            }
+            previous = cell;
+            cell = next;
+        }
+    }
+    return arm_count;
+}
+
+// Colours (1 for white, 3 for black) of the pieces on an arm, leaf first
+static int arm_pieces(board_t board, const Arm *arm, int pieces[])
+{
+    int count = 0;
+    for (int i = 0; i < arm->length; i++)
+    {
+        uint32_t val = (board >> (2 * (NUM_POSITIONS - 1 - arm->cells[i]))) & 0b11;
+        if (val != 0)
+            pieces[count++] = val;
+    }
+    return count;
+}
+
+// Two-colours the cells; returns 0 when the graph has an odd cycle
+static int colour_graph(const int neighbors[NUM_POSITIONS][4], int side[NUM_POSITIONS])
+{
+    for (int i = 0; i < NUM_POSITIONS; i++)
+        side[i] = -1;
+    for (int root = 0; root < NUM_POSITIONS; root++)
+    {
+        if (side[root] != -1)
+            continue;
+        int queue[NUM_POSITIONS];
+        int head = 0, tail = 0;
+        side[root] = 0;
+        queue[tail++] = root;
+        while (head < tail)
+        {
+            int cell = queue[head++];
+            for (int j = 0; j < 4 && neighbors[cell][j] != -1; j++)
+            {
+                int next = neighbors[cell][j];
+                if (side[next] == -1)
+                {
+                    side[next] = 1 - side[cell];
+                    queue[tail++] = next;
+                }
+                else if (side[next] == side[cell])
+                {
+                    return 0;
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+// Returns ORACLE_UNSOLVABLE when the puzzle provably has no solution, and
+// otherwise a lower bound on its number of moves
+static int check_puzzle(const Heuristic *heuristic, const int neighbors[NUM_POSITIONS][4], board_t board_start,
+                        board_t board_goal)
+{
+    int pieces = 0;
+    for (int colour = PDB_PATTERN_WHITE; colour <= PDB_PATTERN_BLACK; colour++)
+    {
+        uint64_t start_cells = colour_cells(board_start, colour), goal_cells = colour_cells(board_goal, colour);
+        if (__builtin_popcountll(start_cells) != __builtin_popcountll(goal_cells))
+            return ORACLE_UNSOLVABLE;
+        pieces += __builtin_popcountll(start_cells);
+    }
+    if (board_start == board_goal)
+        return 0;
+
+    board_t children[MAX_CHILDREN];
+    int child_moves[MAX_CHILDREN];
+    if (generate_children(board_start, neighbors, children, child_moves) == 0 ||
+        generate_children(board_goal, neighbors, children, child_moves) == 0)
+        return ORACLE_UNSOLVABLE; // One end cannot move at all
+
+    Arm arms[NUM_POSITIONS];
+    int arm_count = find_arms(neighbors, arms);
+    int empty = NUM_POSITIONS - pieces;
+    for (int a = 0; a < arm_count; a++)
+    {
+        int trapped = arms[a].has_junction ? arms[a].length - empty : NUM_POSITIONS;
+        if (trapped <= 0)
+            continue;
+        int start_pieces[NUM_POSITIONS], goal_pieces[NUM_POSITIONS];
+        int start_count = arm_pieces(board_start, &arms[a], start_pieces);
+        int goal_count = arm_pieces(board_goal, &arms[a], goal_pieces);
+        int start_trapped = start_count < trapped ? start_count : trapped;
+        int goal_trapped = goal_count < trapped ? goal_count : trapped;
+        if (start_trapped != goal_trapped)
+            return ORACLE_UNSOLVABLE;
+        for (int i = 0; i < start_trapped; i++)
+        {
+            if (start_pieces[i] != goal_pieces[i])
+                return ORACLE_UNSOLVABLE;
+        }
+    }
+
+    int bound = estimate_moves(heuristic, board_start);
+    if (bound == DEAD_END)
+        return ORACLE_UNSOLVABLE;
+    int side[NUM_POSITIONS];
+    if (colour_graph(neighbors, side))
+    {
+        int parity = 0;
+        for (int i = 0; i < NUM_POSITIONS; i++)
+        {
+            if (side[i] == 1)
+                parity += ((board_start >> (2 * (NUM_POSITIONS - 1 - i))) & 0b01) +
+                          ((board_goal >> (2 * (NUM_POSITIONS - 1 - i))) & 0b01);
+        }
+        if ((bound & 1) != (parity & 1))
+            bound++;
+    }
+    return bound;
+}
+#pragma endregion
+
+#pragma region Tablebase
+// Answers from a tablebase (see tb_gen.c) instead of searching. The stored
+// distance is exact, so from every board some move leads to a board one
+// closer to the goal; following those moves rebuilds a shortest path in
+// distance * children lookups. The caller checks that the start's distance
+// is below PDB_MAX_DISTANCE, since clamped values cannot be descended.
+static void solve_tablebase(const PatternDb *table, board_t board_start, board_t board_goal,
+                            const int neighbors[NUM_POSITIONS][4], int moves[], int *move_count)
+{
+    board_t children[MAX_CHILDREN];
+    int child_moves[MAX_CHILDREN];
+    board_t board = board_start;
+    int distance = tablebase_distance(table, board_goal, board);
+    *move_count = 0;
+    while (distance > 0)
+    {
+        int count = generate_children(board, neighbors, children, child_moves);
+        for (int i = 0; i < count; i++)
+        {
+            if (tablebase_distance(table, board_goal, children[i]) == distance - 1)
+            {
+                board = children[i];
+                moves[(*move_count)++] = child_moves[i];
+                break;
+            }
+        }
+        distance--;
+    }
+}
+#pragma endregion
+
+#pragma region Goal Distance Cache
+// Moves are reversible, so one BFS from a goal gives every board's distance
+// to it, which answers every start for that goal. The cache keeps these maps
+// (one byte per ranked board, as in a tablebase) keyed by goal board, within
+// a memory budget, dropping the least recently used map to make room. A
+// goal's first query builds its map; later ones walk down the distances
+// like a tablebase, without searching. Distances clamp at PDB_MAX_DISTANCE
+// and such starts fall back to the engine.
+#define GOAL_CACHE_BUCKETS 1024 // Power of two
+
+typedef struct GoalMap
+{
+    board_t goal;
+    uint32_t size;       // Ranked boards, one byte each
+    uint8_t *distances;  // Moves to the goal, PDB_UNREACHABLE if none
+    struct GoalMap *next; // In the same bucket
+    struct GoalMap *newer;
+    struct GoalMap *older;
+} GoalMap;
+
+typedef struct GoalCache
+{
+    size_t budget; // Bytes of distances; 0 turns the cache off
+    size_t used;
+    GoalMap *buckets[GOAL_CACHE_BUCKETS];
+    GoalMap *newest; // Least recently used last
+    GoalMap *oldest;
+} GoalCache;
+
+static inline GoalMap **goal_bucket(GoalCache *cache, board_t goal)
+{
+    return &cache->buckets[(rank_board(goal) * 2654435761u) >> 22 & (GOAL_CACHE_BUCKETS - 1)];
+}
+
+static void unlink_goal_map(GoalCache *cache, GoalMap *map)
+{
+    if (map->newer != NULL)
+        map->newer->older = map->older;
+    else
+        cache->newest = map->older;
+    if (map->older != NULL)
+        map->older->newer = map->newer;
+    else
+        cache->oldest = map->newer;
+}
+
+static void push_newest_goal_map(GoalCache *cache, GoalMap *map)
+{
+    map->newer = NULL;
+    map->older = cache->newest;
+    if (cache->newest != NULL)
+        cache->newest->newer = map;
+    cache->newest = map;
+    if (cache->oldest == NULL)
+        cache->oldest = map;
+}
+
+// Returns the map for goal and marks it most recently used, or NULL
+static GoalMap *find_goal_map(GoalCache *cache, board_t goal)
+{
+    GoalMap *map = *goal_bucket(cache, goal);
+    while (map != NULL && map->goal != goal)
+        map = map->next;
+    if (map != NULL && map != cache->newest)
+    {
+        unlink_goal_map(cache, map);
+        push_newest_goal_map(cache, map);
+    }
+    return map;
+}
+
+static void evict_goal_map(GoalCache *cache)
+{
+    GoalMap *map = cache->oldest;
+    GoalMap **link = goal_bucket(cache, map->goal);
+    while (*link != map)
+        link = &(*link)->next;
+    *link = map->next;
+    unlink_goal_map(cache, map);
+    cache->used -= map->size;
+    free(map->distances);
+    free(map);
+}
+
+static void clear_goal_cache(GoalCache *cache)
+{
+    while (cache->oldest != NULL)
+        evict_goal_map(cache);
+}
+
+// Runs the BFS from goal and caches its distances. Returns NULL when the map
+// would not fit in the budget or memory runs out.
+static GoalMap *build_goal_map(GoalCache *cache, board_t goal, int whites, int blacks,
+                               const int neighbors[NUM_POSITIONS][4], SearchStats *stats)
+{
+    rank_t size = count_states(whites, blacks);
+    if (size > MAX_RANKED_STATES || size > cache->budget)
+        return NULL;
+    while (cache->used + size > cache->budget)
+        evict_goal_map(cache);
+
+    GoalMap *map = (GoalMap *)malloc(sizeof(GoalMap));
+    uint8_t *distances = (uint8_t *)malloc(size);
+    board_t *queue = (board_t *)malloc(size * sizeof(board_t));
+    if (map == NULL || distances == NULL || queue == NULL)
+    {
+        perror("Failed to allocate memory for goal distances");
+        free(map);
+        free(distances);
+        free(queue);
+        return NULL;
+    }
+    memset(distances, PDB_UNREACHABLE, size);
+
+    board_t children[MAX_CHILDREN];
+    int child_moves[MAX_CHILDREN];
+    uint32_t head = 0, tail = 0;
+    distances[rank_board(goal)] = 0;
+    queue[tail++] = goal;
+    while (head < tail)
+    {
+        board_t board = queue[head++];
+        int next = distances[rank_board(board)] + 1;
+        if (next > PDB_MAX_DISTANCE)
+            next = PDB_MAX_DISTANCE;
+        int count = generate_children(board, neighbors, children, child_moves);
+        stats->expanded++;
+        stats->generated += count;
+        for (int i = 0; i < count; i++)
+        {
+            uint32_t rank = rank_board(children[i]);
+            if (distances[rank] != PDB_UNREACHABLE)
+            {
+                stats->duplicates++;
+                continue;
+            }
+            distances[rank] = next;
+            queue[tail++] = children[i];
+        }
+    }
+    stats->peak_queue = tail; // Every board reached stays in the queue
+    free(queue);
+
+    map->goal = goal;
+    map->size = size;
+    map->distances = distances;
+    GoalMap **bucket = goal_bucket(cache, goal);
+    map->next = *bucket;
+    *bucket = map;
+    push_newest_goal_map(cache, map);
+    cache->used += size;
+    return map;
+}
+
+// Walks down the map from board_start. Returns 1 with the moves written, 0
+// when the goal cannot be reached, and -1 when the start's distance is
+// clamped.
+static int descend_goal_map(const GoalMap *map, board_t board_start, const int neighbors[NUM_POSITIONS][4],
+                            int moves[], int *move_count)
+{
+    board_t children[MAX_CHILDREN];
+    int child_moves[MAX_CHILDREN];
+    board_t board = board_start;
+    int distance = map->distances[rank_board(board)];
+    *move_count = 0;
+    if (distance == PDB_UNREACHABLE)
+        return 0;
+    if (distance == PDB_MAX_DISTANCE)
+        return -1;
+    while (distance > 0)
+    {
+        int count = generate_children(board, neighbors, children, child_moves);
+        for (int i = 0; i < count; i++)
+        {
+            if (map->distances[rank_board(children[i])] == distance - 1)
+            {
+                board = children[i];
+                moves[(*move_count)++] = child_moves[i];
+                break;
+            }
+        }
+        distance--;
+    }
+    return 1;
+}
+#pragma endregion
+
+#pragma region Solver
+struct Solver
+{
+    Engine engine;
+    int threads;  // Workers for ENGINE_PARALLEL_BFS
+    int symmetry; // Let ENGINE_BFS fold boards with their mirror images
+    const int (*neighbors)[4];            // board_neighbors or topology
+    int topology[NUM_POSITIONS][4];       // From solver_load_topology
+    int distances[NUM_POSITIONS][NUM_POSITIONS];
+    PatternDb pattern_dbs[2];
+    PatternDb tablebases[MAX_TABLEBASES];
+    int tablebase_count;
+    // ENGINE_BFS's tables, allocated by its first search (see reserve_bfs)
+    Queue queue;
+    VisitedSet visited;
+    Predecessor *predecessors; // predecessor_capacity entries
+    uint32_t predecessor_capacity;
+    int whites; // Piece counts the visited set is sized for
+    int blacks;
+    int *moves; // path_capacity entries, allocated by the first solve
+    uint32_t path_capacity;
+    GoalCache goal_cache;
+    size_t external_memory; // Cap for ENGINE_EXTERNAL
+    char *scratch_dir;      // Where ENGINE_EXTERNAL writes, NULL for the default
+    SearchStats stats; // Of the last solve call
+};
+
+// The binomial table is shared by every solver in the process
+static pthread_once_t binomials_once = PTHREAD_ONCE_INIT;
+
+Solver *solver_create(Engine engine, int threads)
+{
+    pthread_once(&binomials_once, init_binomials);
+    Solver *solver = (Solver *)calloc(1, sizeof(Solver));
+    if (solver == NULL)
+    {
+        perror("Failed to allocate memory for solver");
+        return NULL;
+    }
+    solver->engine = engine;
+    solver->threads = threads > 0 ? threads : 1;
+#ifdef HAS_BUILTIN_BOARD
+    solver->neighbors = board_neighbors;
+#else
+    memset(solver->topology, 0xFF, sizeof(solver->topology)); // No edges until a topology is loaded
+    solver->neighbors = solver->topology;
+#endif
+    solver->whites = solver->blacks = -1;
+    solver->external_memory = EXTERNAL_DEFAULT_MEMORY;
+    init_distances(solver->neighbors, solver->distances);
+    return solver;
+}
+
+// Pattern databases, tablebases and the mirror symmetry all belong to the
+// built-in board
+static int on_builtin_board(const Solver *solver)
+{
+#ifdef HAS_BUILTIN_BOARD
+    return solver->neighbors == board_neighbors;
+#else
+    return 0;
+#endif
+}
+
+int solver_load_topology(Solver *solver, const char *path)
+{
+    int neighbors[NUM_POSITIONS][4];
+    if (!load_topology(path, neighbors))
+        return 0;
+    int builtin = 0;
+#ifdef HAS_BUILTIN_BOARD
+    // A file describing the built-in board keeps its bitboard move generator
+    builtin = memcmp(neighbors, board_neighbors, sizeof(neighbors)) == 0;
+#endif
+    if (!builtin && (solver->pattern_dbs[PDB_PATTERN_WHITE].header != NULL ||
+                     solver->pattern_dbs[PDB_PATTERN_BLACK].header != NULL || solver->tablebase_count > 0))
+    {
+        fprintf(stderr, "Error: The loaded databases are made for the built-in board, not the one in %s.\n", path);
+        return 0;
+    }
+    memcpy(solver->topology, neighbors, sizeof(neighbors));
+    solver->neighbors = solver->topology;
+#ifdef HAS_BUILTIN_BOARD
+    if (builtin)
+        solver->neighbors = board_neighbors;
+#endif
+    init_distances(solver->neighbors, solver->distances);
+    clear_goal_cache(&solver->goal_cache);
+    return 1;
+}
+
+void solver_set_symmetry(Solver *solver, int symmetry)
+{
+    solver->symmetry = symmetry;
+}
+
+void solver_set_goal_cache(Solver *solver, size_t budget)
+{
+    solver->goal_cache.budget = budget;
+    while (solver->goal_cache.used > budget)
+        evict_goal_map(&solver->goal_cache);
+}
+
+int solver_set_external(Solver *solver, size_t memory, const char *scratch_dir)
+{
+    if (memory < EXTERNAL_MIN_MEMORY)
+    {
+        fprintf(stderr, "Error: External search needs at least %zu KB of memory.\n", EXTERNAL_MIN_MEMORY >> 10);
+        return 0;
+    }
+    char *copy = NULL;
+    if (scratch_dir != NULL && (copy = strdup(scratch_dir)) == NULL)
+    {
+        perror("Failed to allocate memory for scratch directory");
+        return 0;
+    }
+    free(solver->scratch_dir);
+    solver->scratch_dir = copy;
+    solver->external_memory = memory;
+    return 1;
+}
+
+static const char *scratch_dir(const Solver *solver)
+{
+    const char *dir = solver->scratch_dir != NULL ? solver->scratch_dir : getenv("TMPDIR");
+    return dir != NULL && dir[0] != '\0' ? dir : "/tmp";
+}
+
+int solver_load_pattern_db(Solver *solver, const char *path)
+{
+    PatternDb pdb;
+    if (!on_builtin_board(solver))
+    {
+        fprintf(stderr, "Error: %s is made for the built-in board, not the loaded topology.\n", path);
+        return 0;
+    }
+    if (!load_pattern_db(path, &pdb))
+        return 0;
+    if (pdb.header->pattern > PDB_PATTERN_BLACK)
+    {
+        fprintf(stderr, "Error: Pattern database %s is a tablebase, not a pattern database.\n", path);
+        unload_pattern_db(&pdb);
+        return 0;
+    }
+    unload_pattern_db(&solver->pattern_dbs[pdb.header->pattern]);
+    solver->pattern_dbs[pdb.header->pattern] = pdb;
+    return 1;
+}
+
+int solver_load_tablebase(Solver *solver, const char *path)
+{
+    if (solver->tablebase_count == MAX_TABLEBASES)
+    {
+        fprintf(stderr, "Error: No room for tablebase %s, at most %d can be loaded.\n", path, MAX_TABLEBASES);
+        return 0;
+    }
+    if (!on_builtin_board(solver))
+    {
+        fprintf(stderr, "Error: %s is made for the built-in board, not the loaded topology.\n", path);
+        return 0;
+    }
+    PatternDb table;
+    if (!load_pattern_db(path, &table))
+        return 0;
+    if (table.header->pattern < PDB_PATTERN_BOTH)
+    {
+        fprintf(stderr, "Error: %s is a pattern database, not a tablebase.\n", path);
+        unload_pattern_db(&table);
+        return 0;
+    }
+    solver->tablebases[solver->tablebase_count++] = table;
+    return 1;
+}
+
+// Returns the loaded tablebase with exact distances to this goal, or NULL
+static const PatternDb *find_tablebase(const Solver *solver, board_t board_goal, int whites, int blacks)
+{
+    for (int i = 0; i < solver->tablebase_count; i++)
+    {
+        if (tablebase_covers(&solver->tablebases[i], board_goal, whites, blacks))
+            return &solver->tablebases[i];
+    }
+    return NULL;
+}
+
+const char *solver_check_tables(const Solver *solver, board_t goal)
+{
+    int whites, blacks;
+    if (!count_pieces(goal, &whites, &blacks))
+        return "Invalid goal board";
+    for (int pattern = PDB_PATTERN_WHITE; pattern <= PDB_PATTERN_BLACK; pattern++)
+    {
+        const PatternDbHeader *header = solver->pattern_dbs[pattern].header;
+        if (header != NULL && (header->whites != (uint32_t)whites || header->blacks != (uint32_t)blacks ||
+                               header->goal_cells != colour_cells(goal, pattern)))
+            return "Pattern database does not match this puzzle";
+    }
+    if (solver->tablebase_count > 0 && find_tablebase(solver, goal, whites, blacks) == NULL)
+        return "Tablebase does not match this puzzle";
+    return NULL;
+}
+
+int validate_puzzle(const char *pieces[4], char *error, size_t error_size)
+{
+    static const char *kinds[4] = {"piece", "piece", "goal", "goal"};
+    static const char *colours[4] = {"white", "black", "white", "black"};
+
+    if (strlen(pieces[0]) != strlen(pieces[2]) || strlen(pieces[1]) != strlen(pieces[3]))
+    {
+        snprintf(error, error_size, "Starting and ending positions must have the same number of pieces");
+        return 0;
+    }
+    // Check for valid piece positions and ensure they are unique
+    for (int p = 0; p < 4; p++)
+    {
+        for (int i = 0; pieces[p][i] != '\0'; i++)
+        {
+            if (strchr(pieces[p], pieces[p][i]) != strrchr(pieces[p], pieces[p][i]))
+            {
+                snprintf(error, error_size, "Duplicate %s positions in %s pieces", kinds[p], colours[p]);
+                return 0;
+            }
+        }
+    }
+    for (int p = 0; p < 4; p++)
+    {
+        for (int i = 0; pieces[p][i] != '\0'; i++)
+        {
+            if (cell_index(pieces[p][i]) < 0)
+            {
+                snprintf(error, error_size, "Invalid %s position in %s pieces: %c", kinds[p], colours[p], pieces[p][i]);
+                return 0;
+            }
+        }
+    }
+    // A cell can only hold one piece
+    for (int p = 0; p < 4; p += 2)
+    {
+        for (int i = 0; pieces[p][i] != '\0'; i++)
+        {
+            if (strchr(pieces[p + 1], pieces[p][i]) != NULL)
+            {
+                snprintf(error, error_size, "Position %c holds both a white and a black %s", pieces[p][i], kinds[p]);
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+// Pattern databases only help puzzles with their piece counts and goal cells
+static void select_pattern_dbs(const Solver *solver, board_t board_goal, int whites, int blacks,
+                               PatternDb pattern_dbs[2])
+{
+    for (int pattern = PDB_PATTERN_WHITE; pattern <= PDB_PATTERN_BLACK; pattern++)
+    {
+        const PatternDbHeader *header = solver->pattern_dbs[pattern].header;
+        memset(&pattern_dbs[pattern], 0, sizeof(PatternDb));
+        if (header != NULL && header->whites == (uint32_t)whites && header->blacks == (uint32_t)blacks &&
+            header->goal_cells == colour_cells(board_goal, pattern))
+            pattern_dbs[pattern] = solver->pattern_dbs[pattern];
+    }
+}
+
+// Sets up the queue, the visited set and the predecessor table for a BFS
+// with these piece counts, the first time it needs them. Returns 0 when
+// memory runs out.
+static int reserve_bfs(Solver *solver, int whites, int blacks)
+{
+    double init_start = monotonic_ms();
+    if (solver->queue.entries == NULL && !init_queue(&solver->queue))
+        return 0;
+    if (whites != solver->whites || blacks != solver->blacks)
+    {
+        free_visited_set(&solver->visited);
+        solver->whites = solver->blacks = -1;
+        if (!init_visited_set(&solver->visited, whites, blacks))
+            return 0;
+        solver->whites = whites;
+        solver->blacks = blacks;
+    }
+    // The BFS dequeues each board at most once (see reserve_tables for the bound)
+    uint32_t size = count_states(whites, blacks);
+    if (size > solver->predecessor_capacity)
+    {
+        Predecessor *predecessors = (Predecessor *)realloc(solver->predecessors, size * sizeof(Predecessor));
+        if (predecessors == NULL)
+        {
+            perror("Failed to allocate memory for predecessors");
+            return 0;
+        }
+        solver->predecessors = predecessors;
+        solver->predecessor_capacity = size;
+    }
+    solver->stats.init_ms += monotonic_ms() - init_start;
+    return 1;
+}
+
+// Solves one puzzle the oracle cannot rule out, from a matching tablebase if
+// there is one and otherwise with the solver's engine, leaving the moves in
+// solver->moves. Returns 1 when solved, 0 when there is no solution and -1
+// on allocation failure.
+static int solve_puzzle(Solver *solver, board_t board_start, board_t board_goal, int whites, int blacks,
+                        int *move_count)
+{
+    SearchStats *stats = &solver->stats;
+    PatternDb pattern_dbs[2];
+    select_pattern_dbs(solver, board_goal, whites, blacks, pattern_dbs);
+
+    // Reject what the oracle can rule out before touching any table
+    Heuristic heuristic;
+    init_heuristic(&heuristic, board_goal, solver->distances, pattern_dbs);
+    int lower_bound = check_puzzle(&heuristic, solver->neighbors, board_start, board_goal);
+    *move_count = 0;
+    if (lower_bound == ORACLE_UNSOLVABLE)
+        return 0;
+
+    const PatternDb *table = find_tablebase(solver, board_goal, whites, blacks);
+    if (table != NULL)
+    {
+        int distance = tablebase_distance(table, board_goal, board_start);
+        if (distance == PDB_UNREACHABLE)
+            return 0;
+        if (distance < PDB_MAX_DISTANCE)
+        {
+            solve_tablebase(table, board_start, board_goal, solver->neighbors, solver->moves, move_count);
+            return 1;
+        }
+    }
+
+    if (solver->goal_cache.budget > 0)
+    {
+        GoalMap *map = find_goal_map(&solver->goal_cache, board_goal);
+        if (map == NULL)
+            map = build_goal_map(&solver->goal_cache, board_goal, whites, blacks, solver->neighbors, stats);
+        if (map != NULL)
+        {
+            double reconstruct_start = monotonic_ms();
+            int found = descend_goal_map(map, board_start, solver->neighbors, solver->moves, move_count);
+            stats->reconstruct_ms += monotonic_ms() - reconstruct_start;
+            if (found >= 0)
+                return found;
+        }
+    }
+
+    switch (solver->engine)
+    {
+    case ENGINE_ASTAR:
+        return solve_astar(board_start, board_goal, solver->neighbors, solver->distances, pattern_dbs,
+                           whites, blacks, solver->moves, move_count, stats);
+    case ENGINE_IDASTAR:
+        return solve_idastar(board_start, board_goal, solver->neighbors, solver->distances, pattern_dbs,
+                             whites, blacks, lower_bound, solver->moves, move_count, stats);
+    case ENGINE_PARALLEL_BFS:
+        return solve_parallel_bfs(board_start, board_goal, solver->neighbors, whites, blacks, solver->threads,
+                                  solver->moves, move_count, stats);
+    case ENGINE_LAYERED:
+        return solve_layered(board_start, board_goal, solver->neighbors, solver->moves, move_count, stats);
+    case ENGINE_MOD3:
+        return solve_mod3(board_start, board_goal, solver->neighbors, whites, blacks, solver->moves, move_count,
+                          stats);
+    case ENGINE_EXTERNAL:
+        return solve_external(board_start, board_goal, solver->neighbors, solver->external_memory,
+                              scratch_dir(solver), &solver->moves, &solver->path_capacity, move_count, stats);
+    case ENGINE_BIDIRECTIONAL:
+        return solve_bidirectional(board_start, board_goal, solver->neighbors, whites, blacks, solver->moves,
+                                   move_count, stats);
+    default:
+        break;
+    }
+
+    if (!reserve_bfs(solver, whites, blacks))
+        return -1;
+
+    // Folding boards with their images only keeps distances to a target that
+    // is its own image, so search towards whichever end is symmetric and turn
+    // the path around when that is the start. The queue holds real boards, so
+    // the predecessor chain is a real path whichever image was stored.
+    int symmetries = 0, reversed = 0;
+    if (solver->symmetry && on_builtin_board(solver))
+    {
+        symmetries = board_symmetries(board_goal, whites, blacks);
+        if (symmetries == 0 && (symmetries = board_symmetries(board_start, whites, blacks)) != 0)
+            reversed = 1;
+    }
+    solver->visited.symmetries = symmetries;
+    solver->visited.probes = 0;
+    int found;
+    if (!reversed)
+    {
+        found = solve_bfs(&solver->queue, &solver->visited, solver->predecessors, board_start, board_goal,
+                          solver->neighbors, solver->moves, move_count, stats);
+    }
+    else
+    {
+        found = solve_bfs(&solver->queue, &solver->visited, solver->predecessors, board_goal, board_start,
+                          solver->neighbors, solver->moves, move_count, stats);
+        if (found == 1)
+            reverse_path(solver->moves, *move_count);
+    }
+    stats->probes += solver->visited.probes;
+    return found;
+}
+
+// Ranks are 32-bit (see board.h), and a path takes at most one entry per
+// board, so the path grows to the number of boards with these piece counts
+static int reserve_tables(Solver *solver, int whites, int blacks)
+{
+    rank_t size = count_states(whites, blacks);
+    if (size > MAX_RANKED_STATES)
+    {
+        fprintf(stderr, "Error: Too many boards with %d white and %d black pieces to search.\n", whites, blacks);
+        return 0;
+    }
+    if (size <= solver->path_capacity)
+        return 1;
+    int *moves = (int *)realloc(solver->moves, size * sizeof(int));
+    if (moves == NULL)
+    {
+        perror("Failed to allocate memory for path");
+        return 0;
+    }
+    solver->moves = moves;
+    solver->path_capacity = size;
+    return 1;
+}
+
+int solve(Solver *solver, board_t start, board_t goal, const int **moves_out, int *len_out)
+{
+    int whites, blacks, goal_whites, goal_blacks;
+    memset(&solver->stats, 0, sizeof(solver->stats));
+    *moves_out = solver->moves;
+    *len_out = 0;
+    if (!count_pieces(start, &whites, &blacks) || !count_pieces(goal, &goal_whites, &goal_blacks))
+        return -1;
+    if (whites != goal_whites || blacks != goal_blacks)
+        return 0;
+    // The external search ranks nothing and sizes the path itself, so it
+    // takes state spaces too large for the tables. Smaller ones still get a
+    // path for the tablebase and goal-map answers.
+    int rankable = count_states(whites, blacks) <= MAX_RANKED_STATES;
+    if ((solver->engine != ENGINE_EXTERNAL || rankable) && !reserve_tables(solver, whites, blacks))
+        return -1;
+    uint64_t cycles_start = read_cycles();
+    int found = solve_puzzle(solver, start, goal, whites, blacks, len_out);
+    solver->stats.cycles = read_cycles() - cycles_start;
+    *moves_out = solver->moves;
+    return found;
+}
+
+int solver_lower_bound(const Solver *solver, board_t start, board_t goal)
+{
+    int whites, blacks, goal_whites, goal_blacks;
+    if (!count_pieces(start, &whites, &blacks) || !count_pieces(goal, &goal_whites, &goal_blacks) ||
+        whites != goal_whites || blacks != goal_blacks)
+        return -1;
+    PatternDb pattern_dbs[2];
+    select_pattern_dbs(solver, goal, whites, blacks, pattern_dbs);
+    Heuristic heuristic;
+    init_heuristic(&heuristic, goal, solver->distances, pattern_dbs);
+    int bound = check_puzzle(&heuristic, solver->neighbors, start, goal);
+    return bound == ORACLE_UNSOLVABLE ? -1 : bound;
+}
+
+int solve_paths(Solver *solver, PathQuery query, uint64_t index, board_t start, board_t goal,
+                PathVisitor visit, void *arg, uint64_t *total, int *length)
+{
+    int whites, blacks, goal_whites, goal_blacks;
+    *total = 0;
+    *length = -1;
+    if (!count_pieces(start, &whites, &blacks) || !count_pieces(goal, &goal_whites, &goal_blacks))
+        return -1;
+    if (whites != goal_whites || blacks != goal_blacks)
+        return 0;
+    if (!reserve_tables(solver, whites, blacks))
+        return -1;
+
+    PathCounts paths;
+    int found = count_paths(&paths, start, goal, solver->neighbors, whites, blacks);
+    if (found <= 0)
+    {
+        free_path_counts(&paths);
+        return found;
+    }
+
+    *total = paths.counts[rank_board(start)];
+    *length = paths.distance;
+    if (query == PATHS_INDEX)
+    {
+        if (kth_path(&paths, start, solver->neighbors, index, solver->moves) == 1)
+            visit(solver->moves, paths.distance, arg);
+    }
+    else if (query == PATHS_ALL)
+    {
+        PathIterator iterator;
+        if (!init_path_iterator(&iterator, &paths, start, solver->neighbors))
+            found = -1;
+        else
+        {
+            while (next_path(&iterator, solver->moves))
+                visit(solver->moves, paths.distance, arg);
+            free_path_iterator(&iterator);
+        }
+    }
+    free_path_counts(&paths);
+    return found;
+}
+
+const SearchStats *solver_stats(const Solver *solver)
+{
+    return &solver->stats;
+}
+
+void solver_reset(Solver *solver)
+{
+    free_visited_set(&solver->visited);
+    solver->whites = solver->blacks = -1;
+    reset_queue(&solver->queue);
+    clear_goal_cache(&solver->goal_cache);
+    memset(&solver->stats, 0, sizeof(solver->stats));
+}
+
+void solver_destroy(Solver *solver)
+{
+    if (solver == NULL)
+        return;
+    free_queue(&solver->queue);
+    free_visited_set(&solver->visited);
+    clear_goal_cache(&solver->goal_cache);
+    unload_pattern_db(&solver->pattern_dbs[PDB_PATTERN_WHITE]);
+    unload_pattern_db(&solver->pattern_dbs[PDB_PATTERN_BLACK]);
+    for (int i = 0; i < solver->tablebase_count; i++)
+        unload_pattern_db(&solver->tablebases[i]);
+    free(solver->moves);
+    free(solver->predecessors);
+    free(solver->scratch_dir);
+    free(solver);
+}
+#pragma endregion
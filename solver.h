@@ -0,0 +1,137 @@
+#ifndef SOLVER_H
+#define SOLVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "board_type.h"
+
+// The search engines of prog, built as libsolver.a and libsolver.so (see the
+// Makefile). A Solver holds everything that outlives one puzzle: the engine,
+// the graph distances, loaded pattern databases and tablebases, and the BFS
+// tables, which stay allocated while consecutive puzzles have the same piece
+// counts. Solvers share no mutable state, so each thread can own one:
+//
+//   Solver *solver = solver_create(ENGINE_BFS, 1);
+//   const int *moves;
+//   int move_count;
+//   if (solve(solver, start, goal, &moves, &move_count) == 1)
+//       ...; // move_from(moves[i]) is the cell the i-th move leaves, move_to(moves[i]) the one it enters
+//   solver_destroy(solver);
+//
+// Boards are packed as in board.h: two bits per cell, A in the top pair. The
+// library and its callers must be built with the same BOARD_CELLS.
+
+typedef enum Engine
+{
+    ENGINE_BFS,
+    ENGINE_PARALLEL_BFS,
+    ENGINE_BIDIRECTIONAL,
+    ENGINE_LAYERED,
+    ENGINE_MOD3,
+    ENGINE_ASTAR,
+    ENGINE_IDASTAR,
+    ENGINE_EXTERNAL
+} Engine;
+
+typedef enum PathQuery
+{
+    PATHS_NONE,
+    PATHS_COUNT, // How many shortest paths there are
+    PATHS_ALL,   // Every shortest path, one per line
+    PATHS_INDEX  // The k-th shortest path
+} PathQuery;
+
+#define MAX_TABLEBASES 16
+#define STATS_MAX_DEPTH 256
+#define EXTERNAL_DEFAULT_MEMORY ((size_t)64 << 20) // Bytes
+#define EXTERNAL_MIN_MEMORY ((size_t)64 << 10)     // Bytes
+
+// Counters for the last solve call. They are plain increments on paths that
+// already touch the same cache lines, so they are always kept. Each engine
+// fills in what it tracks: frontier sizes come from the breadth-first
+// engines, and probes are lookups in a visited set, which is a bitmap where
+// prog.c has hash chains, so every probe reads one bit.
+typedef struct SearchStats
+{
+    unsigned long expanded;                  // Boards whose children were generated
+    unsigned long generated;                 // Children generated
+    unsigned long duplicates;                // Children dropped as already seen
+    unsigned long probes;                    // Visited set lookups
+    unsigned long peak_queue;                // Most boards waiting to be expanded at once
+    unsigned long frontier[STATS_MAX_DEPTH]; // Boards first reached at each depth
+    int depth_count;
+    double init_ms;        // Allocating tables for new piece counts
+    double reconstruct_ms; // Rebuilding the path once the goal is found
+    unsigned long cycles;     // Taken by the whole call: time stamp counter ticks, or nanoseconds without one
+    unsigned long runs;       // Sorted runs ENGINE_EXTERNAL wrote
+    unsigned long disk_bytes; // Bytes ENGINE_EXTERNAL wrote to its scratch files
+} SearchStats;
+
+typedef struct Solver Solver;
+
+// Called with each path of a PATHS_ALL or PATHS_INDEX query
+typedef void (*PathVisitor)(const int *moves, int move_count, void *arg);
+
+// Returns NULL when memory runs out. threads is the number of workers for
+// ENGINE_PARALLEL_BFS.
+Solver *solver_create(Engine engine, int threads);
+
+// Replaces the built-in board with the one in a topology file (see board.h).
+// Prints why and returns 0 when the file cannot be used. Builds without a
+// built-in board (BOARD_CELLS other than 14) need one before solving.
+int solver_load_topology(Solver *solver, const char *path);
+
+// Lets ENGINE_BFS fold boards with their mirror images (built-in board only)
+void solver_set_symmetry(Solver *solver, int symmetry);
+
+// Keeps up to budget bytes of goal distance maps, so that later puzzles with
+// a goal seen before are answered without searching. 0, the default, turns
+// the cache off.
+void solver_set_goal_cache(Solver *solver, size_t budget);
+
+// Caps the memory ENGINE_EXTERNAL searches in (EXTERNAL_DEFAULT_MEMORY
+// until set, at least EXTERNAL_MIN_MEMORY) and sets the directory for its
+// scratch files, NULL for $TMPDIR or else /tmp. The search needs about as
+// much disk as the boards it reaches. Returns 0 after printing why when the
+// cap is too small or memory runs out.
+int solver_set_external(Solver *solver, size_t memory, const char *scratch_dir);
+
+// Load a pattern database or a tablebase made by pdb_gen or tb_gen. They
+// print why and return 0 when the file cannot be used.
+int solver_load_pattern_db(Solver *solver, const char *path);
+int solver_load_tablebase(Solver *solver, const char *path);
+
+// Returns why the loaded databases do not fit puzzles ending at goal, or
+// NULL when they all do. solve ignores databases that do not fit.
+const char *solver_check_tables(const Solver *solver, board_t goal);
+
+// Checks the four position strings of a puzzle ("" for a colour with no
+// pieces). On failure, writes the reason into error and returns 0.
+int validate_puzzle(const char *pieces[4], char *error, size_t error_size);
+
+// Finds a shortest path from start to goal. The moves stay valid until the
+// next call on this solver. Returns 1 when solved, 0 when there is no
+// solution, and -1 for an invalid board or when memory runs out.
+int solve(Solver *solver, board_t start, board_t goal, const int **moves_out, int *len_out);
+
+// Returns a lower bound on the moves from start to goal without searching,
+// or -1 when the puzzle provably has no solution or a board is invalid
+int solver_lower_bound(const Solver *solver, board_t start, board_t goal);
+
+// Counts the shortest paths from start to goal into total (saturating at
+// UINT64_MAX) and their moves into length. PATHS_ALL passes every path to
+// visit and PATHS_INDEX the index-th one when the count allows it. Returns
+// the same as solve.
+int solve_paths(Solver *solver, PathQuery query, uint64_t index, board_t start, board_t goal,
+                PathVisitor visit, void *arg, uint64_t *total, int *length);
+
+const SearchStats *solver_stats(const Solver *solver);
+
+// Empties the solver's search tables, goal cache and stats, keeping its
+// engine and databases
+void solver_reset(Solver *solver);
+
+void solver_destroy(Solver *solver);
+
+#endif // SOLVER_H
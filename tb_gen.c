@@ -0,0 +1,145 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "board.h"
+#include "pattern_db.h"
+
+#ifndef HAS_BUILTIN_BOARD
+#error "tb_gen only knows the built-in board (BOARD_CELLS=14)"
+#endif
+
+// Largest all-goals tablebase worth writing: one byte per (goal, board) pair
+#define ALL_GOALS_MAX_BYTES (1ull << 30)
+
+// Builds a tablebase for prog_bin.c (see pattern_db.h). For example
+//
+//   ./tb_gen IJKL CDEF IJKL_CDEF.tb
+//
+// runs one BFS back from the goal board and stores the distance of every
+// board with four white and four black pieces, and
+//
+//   ./tb_gen --all-goals 2 2 all_2_2.tb
+//
+// does the same for every goal board, which only fits for small piece counts.
+
+static int parse_cells(const char *cells, uint32_t *mask)
+{
+    *mask = 0;
+    for (int i = 0; cells[i] != '\0'; i++)
+    {
+        if (cells[i] < 'A' || cells[i] > 'N')
+        {
+            fprintf(stderr, "Error: Invalid goal position: %c\n", cells[i]);
+            return 0;
+        }
+        if (*mask & (1u << (cells[i] - 'A')))
+        {
+            fprintf(stderr, "Error: Duplicate goal positions.\n");
+            return 0;
+        }
+        *mask |= 1u << (cells[i] - 'A');
+    }
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    int all_goals = argc == 5 && strcmp(argv[1], "--all-goals") == 0;
+    if (argc != 4 && !all_goals)
+    {
+        fprintf(stderr, "Usage: %s <white end> <black end> <output file>\n"
+                        "       %s --all-goals <whites> <blacks> <output file>\n",
+                argv[0], argv[0]);
+        return 1;
+    }
+
+    init_binomials();
+    int whites, blacks;
+    uint32_t white_cells = 0, black_cells = 0;
+    const char *path;
+    if (all_goals)
+    {
+        whites = atoi(argv[2]);
+        blacks = atoi(argv[3]);
+        path = argv[4];
+    }
+    else
+    {
+        // "-" stands for a colour with no pieces, as in batch files
+        const char *white_goal = strcmp(argv[1], "-") == 0 ? "" : argv[1];
+        const char *black_goal = strcmp(argv[2], "-") == 0 ? "" : argv[2];
+        if (!parse_cells(white_goal, &white_cells) || !parse_cells(black_goal, &black_cells))
+            return 1;
+        if (white_cells & black_cells)
+        {
+            fprintf(stderr, "Error: A goal position holds both a white and a black piece.\n");
+            return 1;
+        }
+        whites = strlen(white_goal);
+        blacks = strlen(black_goal);
+        path = argv[3];
+    }
+    if (whites < 0 || blacks < 0 || whites + blacks > NUM_POSITIONS)
+    {
+        fprintf(stderr, "Error: Piece counts do not fit on the board.\n");
+        return 1;
+    }
+
+    uint32_t size = count_states(whites, blacks);
+    uint64_t blocks = all_goals ? size : 1;
+    if (blocks * size > ALL_GOALS_MAX_BYTES)
+    {
+        fprintf(stderr, "Error: An all-goals tablebase for %d white and %d black pieces needs %llu bytes.\n",
+                whites, blacks, (unsigned long long)(blocks * size));
+        return 1;
+    }
+    uint8_t *distances = (uint8_t *)malloc(blocks * size);
+    if (distances == NULL)
+    {
+        perror("Failed to allocate memory for tablebase");
+        return 1;
+    }
+
+    // Moves are reversible, so a BFS rooted at the goal gives every board's
+    // distance to it
+    for (uint64_t goal_rank = 0; goal_rank < blocks; goal_rank++)
+    {
+        uint32_t board_goal = all_goals ? unrank_board(goal_rank, whites, blacks) : 0;
+        if (!all_goals)
+        {
+            for (int i = 0; i < NUM_POSITIONS; i++)
+            {
+                if (white_cells & (1u << i))
+                    board_goal |= 0b01u << pos_offset('A' + i);
+                else if (black_cells & (1u << i))
+                    board_goal |= 0b11u << pos_offset('A' + i);
+            }
+        }
+        if (!compute_distances(&board_goal, 1, whites, blacks, board_neighbors, distances + goal_rank * size))
+            return 1;
+    }
+
+    PatternDbHeader header = {PDB_MAGIC, PDB_VERSION, all_goals ? PDB_PATTERN_ALL_GOALS : PDB_PATTERN_BOTH,
+                              whites, blacks, white_cells, size, black_cells};
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        perror(path);
+        return 1;
+    }
+    if (fwrite(&header, sizeof(header), 1, file) != 1 || fwrite(distances, 1, blocks * size, file) != blocks * size)
+    {
+        perror(path);
+        fclose(file);
+        return 1;
+    }
+    fclose(file);
+
+    printf("Wrote %u states for %llu goal boards to %s\n", size, (unsigned long long)blocks, path);
+    free(distances);
+    return 0;
+}